@@ -3,6 +3,15 @@
 #include <string.h>
 #include "cache.hpp"
 
+// accepts plain byte counts or a K/M suffix, e.g. 4K or 2M
+static uint32_t ParseSize(const char * s) {
+	char * end;
+	uint32_t v = strtoul(s, &end, 10);
+	if (*end=='K' || *end=='k') v <<= 10;
+	else if (*end=='M' || *end=='m') v <<= 20;
+	return v;
+}
+
 static void BuildConfiguration(CacheConfig& c, int argc, char ** argv) {
 	for (int i=1; i<argc; ++i) {
 		if (!strcmp(argv[i], "-p")) {
@@ -23,6 +32,116 @@ static void BuildConfiguration(CacheConfig& c, int argc, char ** argv) {
 			c.SetAlgo(argv[i+1]);
 		} else if (!strcmp(argv[i],"-t")) {
 			c.runTests = true;
+		} else if (!strcmp(argv[i],"--pipeline")) {
+			c.pipelined = true;
+		} else if (!strcmp(argv[i],"--sample-sets")) {
+			c.sampleSetRatio = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--sample-intervals")) {
+			c.samplePeriod = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--sample-warmup")) {
+			c.sampleWarmup = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--sample-detail")) {
+			c.sampleDetail = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--mrc")) {
+			c.mrcRate = atof(argv[i+1]);
+		} else if (!strcmp(argv[i],"--mrc-max-samples")) {
+			c.mrcMaxSamples = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--checkpoint")) {
+			c.checkpointAt = strtoull(argv[i+1], nullptr, 10);
+			c.checkpointPath = argv[i+2];
+		} else if (!strcmp(argv[i],"--restore")) {
+			c.restorePath = argv[i+1];
+		} else if (!strcmp(argv[i],"--reset-stats")) {
+			c.resetStats = true;
+		} else if (!strcmp(argv[i],"--tlb")) {
+			c.tlb = true;
+		} else if (!strcmp(argv[i],"--page-walk")) {
+			c.tlb = true;
+			c.pageWalk = true;
+		} else if (!strcmp(argv[i],"--page-size")) {
+			c.pageSize = ParseSize(argv[i+1]);
+		} else if (!strcmp(argv[i],"--dtlb")) {
+			c.dtlbEntries = atoi(argv[i+1]);
+			c.dtlbWays = atoi(argv[i+2]);
+		} else if (!strcmp(argv[i],"--stlb")) {
+			c.stlbEntries = atoi(argv[i+1]);
+			c.stlbWays = atoi(argv[i+2]);
+		} else if (!strcmp(argv[i],"--tlb-policy")) {
+			c.SetTLBPolicy(argv[i+1]);
+		} else if (!strcmp(argv[i],"--index")) {
+			c.SetIndex(argv[i+1]);
+		} else if (!strcmp(argv[i],"--timing")) {
+			c.timing = true;
+		} else if (!strcmp(argv[i],"--mshrs")) {
+			c.timing = true;
+			c.mshrs = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--window")) {
+			c.timing = true;
+			c.window = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--hit-latency")) {
+			c.timing = true;
+			c.hitLatency = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--miss-latency")) {
+			c.timing = true;
+			c.missLatency = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--buffer-latency")) {
+			c.timing = true;
+			c.bufferLatency = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--dram")) {
+			c.timing = true;
+			c.dram = true;
+		} else if (!strcmp(argv[i],"--dram-channels")) {
+			c.timing = true;
+			c.dram = true;
+			c.dramChannels = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--dram-ranks")) {
+			c.timing = true;
+			c.dram = true;
+			c.dramRanks = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--dram-banks")) {
+			c.timing = true;
+			c.dram = true;
+			c.dramBanks = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--dram-row")) {
+			c.timing = true;
+			c.dram = true;
+			c.dramRowSize = ParseSize(argv[i+1]);
+		} else if (!strcmp(argv[i],"--dram-page")) {
+			c.timing = true;
+			c.dram = true;
+			c.dramOpenPage = strcmp(argv[i+1], "closed")!=0;
+		} else if (!strcmp(argv[i],"--dram-map")) {
+			c.timing = true;
+			c.dram = true;
+			c.dramMapping = strcmp(argv[i+1], "line") ? DRAM::RowInterleaved :
+					DRAM::LineInterleaved;
+		} else if (!strcmp(argv[i],"--dram-timing")) {
+			c.timing = true;
+			c.dram = true;
+			c.dramTiming.tRCD_ = atoi(argv[i+1]);
+			c.dramTiming.tCAS_ = atoi(argv[i+2]);
+			c.dramTiming.tRP_ = atoi(argv[i+3]);
+			c.dramTiming.tBURST_ = atoi(argv[i+4]);
+		} else if (!strcmp(argv[i],"--stats-interval")) {
+			c.statsInterval = atoi(argv[i+1]);
+		} else if (!strcmp(argv[i],"--stats-file")) {
+			c.statsPath = argv[i+1];
+		} else if (!strcmp(argv[i],"--stats-format")) {
+			c.statsJson = !strcmp(argv[i+1], "json");
+		} else if (!strcmp(argv[i],"--fast-forward")) {
+			c.fastForward = true;
+		} else if (!strcmp(argv[i],"--no-same-block-filter")) {
+			c.sameBlockFilter = false;
+		} else if (!strcmp(argv[i],"--simd")) {
+			c.SetSIMD(argv[i+1]);
+		} else if (!strcmp(argv[i],"--cat")) {
+			c.SetCAT(argv[i+1], argv[i+2]);
+		} else if (!strcmp(argv[i],"--victim")) {
+			c.victimEntries = atoi(argv[i+1]);
+			c.missCache = false;
+		} else if (!strcmp(argv[i],"--miss-cache")) {
+			c.victimEntries = atoi(argv[i+1]);
+			c.missCache = true;
 		}
 	}
 	c.ComputeStats();
@@ -47,6 +166,7 @@ static void do_block (const CacheConfig& config, CPU& cpu,
 
 static void mxm_blocking (const CacheConfig& config) {
 	CPU cpu(config);
+	const AddressLayout& layout = cpu.GetLayout();
 	std::vector<Address> a;
 	std::vector<Address> b;
 	std::vector<Address> c;
@@ -55,16 +175,20 @@ static void mxm_blocking (const CacheConfig& config) {
 	b.reserve(n);
 	c.reserve(n);
 	for (uint32_t i=0;i<n;++i) {
-		a.push_back(Address(i*sizeof(double)));
-		b.push_back(Address((n+i)*sizeof(double)));
-		c.push_back(Address(((2*n)+i)*sizeof(double)));
+		a.push_back(Address(i*sizeof(double), layout));
+		b.push_back(Address((n+i)*sizeof(double), layout));
+		c.push_back(Address(((2*n)+i)*sizeof(double), layout));
 		cpu.StoreDouble(a[i], static_cast<double>(i));
 		cpu.StoreDouble(b[i], static_cast<double>(i)*2.);
 		cpu.StoreDouble(c[i], 0.);
 	}
 
+	const uint32_t blocks = config.matDims/config.blockFactor;
 	for (uint32_t sj=0; sj<config.matDims; sj+=config.blockFactor) {
 		for (uint32_t si=0; si<config.matDims; si+=config.blockFactor) {
+			cpu.OuterIteration(static_cast<unsigned long long>(blocks) * blocks -
+					(sj/config.blockFactor) * blocks - si/config.blockFactor,
+					a[si], b[sj*config.matDims], c[si+sj*config.matDims]);
 			for (uint32_t sk=0; sk<config.matDims; sk+=config.blockFactor) {
 				do_block(config, cpu, a, b, c, si, sj, sk);
 			}
@@ -105,6 +229,7 @@ static void mxm_blocking (const CacheConfig& config) {
 
 static void mxm (const CacheConfig& config) {
 	CPU cpu(config);
+	const AddressLayout& layout = cpu.GetLayout();
 	std::vector<Address> a;
 	std::vector<Address> b;
 	std::vector<Address> c;
@@ -113,15 +238,17 @@ static void mxm (const CacheConfig& config) {
 	b.reserve(n);
 	c.reserve(n);
 	for (int i=0;i<n;++i) {
-		a.push_back(Address(i*sizeof(double)));
-		b.push_back(Address((n+i)*sizeof(double)));
-		c.push_back(Address(((2*n)+i)*sizeof(double)));
+		a.push_back(Address(i*sizeof(double), layout));
+		b.push_back(Address((n+i)*sizeof(double), layout));
+		c.push_back(Address(((2*n)+i)*sizeof(double), layout));
 		cpu.StoreDouble(a[i], static_cast<double>(i));
 		cpu.StoreDouble(b[i], static_cast<double>(i)*2.);
 		cpu.StoreDouble(c[i], 0.);
 	}
 
 	for (uint32_t i=0;i<config.matDims;++i) {
+		cpu.OuterIteration(config.matDims - i, a[i*config.matDims], b[0],
+				c[i*config.matDims]);
 		for (uint32_t j=0;j<config.matDims;++j) {
 			double r4 = 0;
 			for (uint32_t k=0;k<config.matDims;++k) {
@@ -169,6 +296,7 @@ static void mxm (const CacheConfig& config) {
 
 static void daxpy (const CacheConfig& config) {
 	CPU cpu(config);
+	const AddressLayout& layout = cpu.GetLayout();
 	std::vector<Address> a;
 	std::vector<Address> b;
 	std::vector<Address> c;
@@ -178,9 +306,9 @@ static void daxpy (const CacheConfig& config) {
 	c.reserve(n);
 
 	for (int i=0;i<n;++i) {
-		a.push_back(Address(i*sizeof(double)));
-		b.push_back(Address((n+i)*sizeof(double)));
-		c.push_back(Address(((2*n)+i)*sizeof(double)));
+		a.push_back(Address(i*sizeof(double), layout));
+		b.push_back(Address((n+i)*sizeof(double), layout));
+		c.push_back(Address(((2*n)+i)*sizeof(double), layout));
 		cpu.StoreDouble(a[i], static_cast<double>(i));
 		cpu.StoreDouble(b[i], static_cast<double>(i)*2.);
 		cpu.StoreDouble(c[i], 0.);
@@ -189,6 +317,7 @@ static void daxpy (const CacheConfig& config) {
 	double r0 = 3.;
 	double r1, r2, r3, r4;
 	for (int i=0; i<n; ++i) {
+		cpu.OuterIteration(n - i, a[i], b[i], c[i]);
 		r1 = cpu.LoadDouble(a[i]);
 		r2 = cpu.MultDouble(r0, r1);
 		r3 = cpu.LoadDouble(b[i]);
@@ -215,13 +344,18 @@ static void daxpy (const CacheConfig& config) {
 
 int main (int argc, char ** argv) {
 	CacheConfig c;
-	BuildConfiguration(c, argc, argv);
-	if (c.algo==c.daxpy) {
-		daxpy(c);
-	} else if (c.algo==c.mxm) {
-		mxm(c);
-	} else if (c.algo==c.mxm_blocking) {
-		mxm_blocking(c);
+	try {
+		BuildConfiguration(c, argc, argv);
+		if (c.algo==c.daxpy) {
+			daxpy(c);
+		} else if (c.algo==c.mxm) {
+			mxm(c);
+		} else if (c.algo==c.mxm_blocking) {
+			mxm_blocking(c);
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << ". Aborting.\n";
+		return EXIT_FAILURE;
 	}
 	std::cout << "cache-sim terminating\n";
 	return EXIT_SUCCESS;
@@ -1,19 +1,43 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
 #include <memory>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 #include <bitset>
 #include <list>
 #include <unordered_map>
+#include <thread>
+#include <atomic>
 #define NDEBUG
 #include <assert.h>
 #include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ringbuffer.hpp"
+#include "sampling.hpp"
+#include "tagsearch.hpp"
+#include "tagcache.hpp"
+#include "shards.hpp"
+#include "tlb.hpp"
+#include "timing.hpp"
+#include "intervals.hpp"
+#include "steady.hpp"
 
 //#define CACHE_DEBUG
 uint32_t constexpr ADDRLEN = 32;
 uint32_t constexpr MATS = 3;
+// cache allocation classes: core 0, which owns every access outside
+// the regions, and one per kernel array
+uint32_t constexpr CLASSES = 1 + MATS;
 
 static inline uint32_t
 GetBitLength(uint32_t val) {
@@ -22,6 +46,49 @@ GetBitLength(uint32_t val) {
 	return ret;
 }
 
+// Lemire's fastmod: x % d as two multiplications by constants fixed
+// when d is known, exact for every 32-bit x and d.
+struct FastMod {
+	uint64_t m_;
+	uint32_t d_;
+	FastMod(uint32_t d) : m_(UINT64_C(0xFFFFFFFFFFFFFFFF) / d + 1), d_(d) {}
+	uint32_t operator()(const uint32_t x) const {
+		__extension__ typedef unsigned __int128 uint128;
+		return static_cast<uint32_t>((static_cast<uint128>(this->m_ * x) * this->d_) >> 64);
+	}
+};
+
+static inline uint32_t
+LargestPrime(uint32_t val) {
+	for (; val > 2; --val) {
+		bool prime = true;
+		for (uint32_t d=2; d*d<=val && prime; ++d) prime = val%d!=0;
+		if (prime) return val;
+	}
+	return val;
+}
+
+// set index function of a cache: fold_ rounds of xoring the next
+// setBits_ tag bits into the block number (zero unless XOR folding),
+// then a fastmod by the set count, which reduces to the plain index
+// bits for power-of-two set counts
+struct IndexFunction {
+	FastMod mod_;
+	uint32_t setBits_;
+	uint32_t fold_;
+	IndexFunction(uint32_t sets, bool xorFold) : mod_(sets),
+		setBits_(GetBitLength(sets) - 1),
+		fold_(xorFold && setBits_ ? (ADDRLEN + setBits_ - 1) / setBits_ - 1 : 0) {}
+	uint32_t operator()(const uint32_t block) const {
+		uint32_t index = block;
+		uint32_t tag = block >> this->setBits_;
+		for (uint32_t i=0; i<this->fold_; ++i) {
+			index ^= tag;
+			tag >>= this->setBits_;
+		}
+		return this->mod_(index);
+	}
+};
 
 struct CacheConfig {
 	uint32_t nWay;
@@ -34,22 +101,97 @@ struct CacheConfig {
 	bool printSolution;
 	enum Policy { LRU, FIFO, Random };
 	enum Algo { daxpy, mxm, mxm_blocking };
+	enum Index { Modulo, XorFold, PrimeModulo, Skewed };
 	Policy policy;
 	Algo algo;
 	uint32_t wordSize;
 	uint32_t ramSize;
+	uint32_t memorySize;
 	uint32_t ramBlockCount;
 	uint32_t totalWords;
 	uint32_t wordsPerBlock;
 	bool runTests;
+	bool pipelined;
+	uint32_t sampleSetRatio;
+	uint32_t samplePeriod;
+	uint32_t sampleWarmup;
+	uint32_t sampleDetail;
+	double mrcRate;
+	uint32_t mrcMaxSamples;
+	unsigned long long checkpointAt;
+	std::string checkpointPath;
+	std::string restorePath;
+	bool resetStats;
+	bool tlb;
+	bool pageWalk;
+	uint32_t pageSize;
+	uint32_t dtlbEntries;
+	uint32_t dtlbWays;
+	uint32_t stlbEntries;
+	uint32_t stlbWays;
+	Policy tlbPolicy;
+	uint32_t dataSize;
+	uint32_t pageTableBase;
+	uint32_t victimEntries;
+	bool missCache;
+	Index index;
+	bool timing;
+	uint32_t mshrs;
+	uint32_t window;
+	uint32_t hitLatency;
+	uint32_t missLatency;
+	// fill latency of a miss the victim or miss buffer serves
+	uint32_t bufferLatency;
+	bool dram;
+	uint32_t dramChannels;
+	uint32_t dramRanks;
+	uint32_t dramBanks;
+	uint32_t dramRowSize;
+	bool dramOpenPage;
+	DRAM::Mapping dramMapping;
+	DRAM::Timing dramTiming;
+	uint32_t statsInterval;
+	std::string statsPath;
+	bool statsJson;
+	// way mask each class may allocate into, 0 for every way
+	uint64_t catMasks[CLASSES];
+	// bytes per kernel array, the span of each region class
+	uint32_t regionSize;
+	bool fastForward;
+	// keep the few blocks last touched, one per set, so repeated
+	// accesses to them skip the set lookup (see Cache::Touch); it
+	// still switches itself off while it rarely hits
+	bool sameBlockFilter;
+	// widest tag search the high-associativity engine may use
+	TagSearch::Level simd;
+	// sets at least this wide use the flat-array engine
+	static uint32_t constexpr ASSOC_WAYS = 16;
 
 	CacheConfig(): nWay(2), cacheSize(65536),
 		blockSize(64), matDims(480),
 		blockFactor(32), cacheBlockCount(0), numSets(0),
 		printSolution(false), policy(LRU), algo(mxm_blocking),
-		wordSize(sizeof(double)), ramSize(0),
+		wordSize(sizeof(double)), ramSize(0), memorySize(0),
 		ramBlockCount(0), totalWords(0), wordsPerBlock(0),
-		runTests(false) {};
+		runTests(false), pipelined(false), sampleSetRatio(0),
+		samplePeriod(0), sampleWarmup(2000), sampleDetail(1000),
+		mrcRate(0), mrcMaxSamples(0), checkpointAt(0), resetStats(false),
+		tlb(false), pageWalk(false), pageSize(4096), dtlbEntries(64),
+		dtlbWays(4), stlbEntries(1536), stlbWays(12), tlbPolicy(LRU),
+		dataSize(0), pageTableBase(0), victimEntries(0), missCache(false),
+		index(Modulo), timing(false), mshrs(8), window(32),
+		hitLatency(4), missLatency(200), bufferLatency(12), dram(false), dramChannels(1),
+		dramRanks(1), dramBanks(8), dramRowSize(8192), dramOpenPage(true),
+		dramMapping(DRAM::RowInterleaved), statsInterval(0), statsJson(false),
+		regionSize(0), fastForward(false), sameBlockFilter(true),
+		simd(TagSearch::AVX2) {
+		std::fill(this->catMasks, this->catMasks + CLASSES, 0);
+		// roughly DDR4-2400 at a 3GHz core clock
+		this->dramTiming.tRCD_ = 42;
+		this->dramTiming.tCAS_ = 42;
+		this->dramTiming.tRP_ = 42;
+		this->dramTiming.tBURST_ = 10;
+	};
 
 	void SetPolicy (char * _policy) {
 		if (!strcmp(_policy, "LRU")) {
@@ -61,6 +203,57 @@ struct CacheConfig {
 		}
 	}
 
+	void SetTLBPolicy (char * _policy) {
+		Policy p = this->policy;
+		this->SetPolicy(_policy);
+		this->tlbPolicy = this->policy;
+		this->policy = p;
+	}
+
+	void SetIndex (char * _index) {
+		if (!strcmp(_index, "modulo")) {
+			this->index = Modulo;
+		} else if (!strcmp(_index, "xor")) {
+			this->index = XorFold;
+		} else if (!strcmp(_index, "prime")) {
+			this->index = PrimeModulo;
+		} else if (!strcmp(_index, "skewed")) {
+			this->index = Skewed;
+		}
+	}
+
+	void SetSIMD (char * _simd) {
+		if (!strcmp(_simd, "scalar")) {
+			this->simd = TagSearch::Scalar;
+		} else if (!strcmp(_simd, "sse2")) {
+			this->simd = TagSearch::SSE2;
+		} else if (!strcmp(_simd, "avx2")) {
+			this->simd = TagSearch::AVX2;
+		}
+	}
+
+	static const char * ClassName(const uint32_t cls) {
+		static const char * const names[CLASSES] = { "core0", "a", "b", "c" };
+		return names[cls];
+	}
+
+	void SetCAT (char * _class, char * _mask) {
+		for (uint32_t cls=0; cls<CLASSES; ++cls) {
+			if (!strcmp(_class, ClassName(cls))) {
+				this->catMasks[cls] = strtoull(_mask, nullptr, 0);
+				return;
+			}
+		}
+		throw std::runtime_error(std::string("unknown allocation class ") + _class);
+	}
+
+	bool Partitioned() const {
+		for (uint32_t cls=0; cls<CLASSES; ++cls) {
+			if (this->catMasks[cls]) return true;
+		}
+		return false;
+	}
+
 	void SetAlgo (char * _algo) {
 		if (!strcmp(_algo, "daxpy")) {
 			this->algo = daxpy;
@@ -75,16 +268,29 @@ struct CacheConfig {
 		// can be re-called as needed
 		this->ramSize = 0;
 		this->ramBlockCount = 0;
+		if (this->nWay==0 || this->blockSize==0 ||
+				(this->blockSize&(this->blockSize-1)) ||
+				this->cacheSize < this->blockSize * this->nWay) {
+			throw std::runtime_error("Cache must hold at least one set " \
+					"of power-of-two sized blocks");
+		}
 		this->cacheBlockCount = this->cacheSize / this->blockSize;
 		this->numSets = this->cacheSize / this->blockSize / this->nWay;
+		if (this->index==PrimeModulo) {
+			// gives up a few sets so strides cannot share a factor
+			this->numSets = LargestPrime(this->numSets);
+		}
 		this->wordsPerBlock = this->blockSize / this->wordSize;
 		if (this->blockSize < sizeof(double)) {
-			std::cerr << "Block size cannot be less " \
-					"than double. Aborting.\n";
-			exit(1);
+			throw std::runtime_error("Block size cannot be less " \
+					"than double");
 		}
 
-		if (this->algo==mxm_blocking || this->algo==mxm) {
+		if (this->memorySize!=0) {
+			// embedded use: the caller bounds the address space
+			this->ramSize = (this->memorySize + this->blockSize - 1) /
+					this->blockSize * this->blockSize;
+		} else if (this->algo==mxm_blocking || this->algo==mxm) {
 			this->ramSize += this->matDims*this->matDims*this->wordSize*MATS;
 		} else {
 			this->ramSize += this->matDims*this->wordSize*MATS;
@@ -92,11 +298,88 @@ struct CacheConfig {
 		this->ramSize += (this->ramSize%blockSize);
 		this->ramBlockCount = this->ramSize / this->blockSize;
 		this->totalWords = this->ramBlockCount * this->wordsPerBlock;
+		this->regionSize = this->totalWords / MATS * this->wordSize;
+		this->dataSize = this->ramSize;
+		if (this->tlb && this->pageWalk) {
+			// page table lives past the matrices, block aligned,
+			// and is not part of totalWords
+			this->pageTableBase = (this->ramSize + this->blockSize - 1) /
+					this->blockSize * this->blockSize;
+			this->ramSize = this->pageTableBase +
+					TLB::TableSize(this->pageSize, this->dataSize);
+			this->ramBlockCount = (this->ramSize + this->blockSize - 1) / this->blockSize;
+		}
 		// the block factor can't be greater than the size of the individual matrices
 		if (this->algo==mxm_blocking) {
 			assert(this->blockFactor<=this->totalWords/MATS);
 			assert(this->matDims%this->blockFactor==0);
 		}
+		if (this->samplePeriod!=0 &&
+				this->samplePeriod < this->sampleWarmup + this->sampleDetail) {
+			throw std::runtime_error("Sampling period cannot be shorter " \
+					"than warm-up plus detail");
+		}
+		if (this->pipelined && this->Sampling()) {
+			throw std::runtime_error("Sampling is not supported " \
+					"in pipelined mode");
+		}
+		if (this->Profiling() && (this->pipelined || this->Sampling() ||
+				this->index==Skewed)) {
+			throw std::runtime_error("MRC profiling cannot be combined " \
+					"with pipelining, sampling or skewed caches");
+		}
+		if ((this->checkpointAt!=0 || !this->restorePath.empty() || this->tlb ||
+				this->timing || this->statsInterval!=0) && !this->Direct()) {
+			throw std::runtime_error("Checkpoints, TLBs, timing and interval stats " \
+					"are only supported in direct simulation");
+		}
+		if (this->fastForward && (!this->Direct() || this->tlb || this->timing ||
+				this->checkpointAt!=0 || !this->restorePath.empty() ||
+				this->statsInterval!=0 || this->index==Skewed)) {
+			throw std::runtime_error("Fast-forward needs direct simulation " \
+					"without TLBs, timing, checkpoints, interval stats " \
+					"or skewed caches");
+		}
+		if (this->Partitioned()) {
+			if (this->nWay > 64) {
+				throw std::runtime_error("Way partitioning supports " \
+						"at most 64 ways");
+			}
+			const uint64_t all = this->nWay==64 ? ~0ull : (1ull << this->nWay) - 1;
+			for (uint32_t cls=0; cls<CLASSES; ++cls) {
+				if (this->catMasks[cls] && !(this->catMasks[cls] & all)) {
+					throw std::runtime_error(std::string("Way mask of class ") +
+							ClassName(cls) + " selects no way");
+				}
+			}
+		}
+		if (this->statsInterval!=0 && this->statsPath.empty()) {
+			this->statsPath = this->statsJson ? "intervals.json" : "intervals.csv";
+		}
+		if ((this->checkpointAt!=0 || !this->restorePath.empty()) &&
+				this->index==Skewed) {
+			throw std::runtime_error("Checkpoints are not supported " \
+					"for skewed caches");
+		}
+		if (this->tlb && (this->dtlbWays==0 || this->stlbWays==0 ||
+				this->dtlbEntries%this->dtlbWays || this->stlbEntries%this->stlbWays ||
+				this->pageSize==0 || (this->pageSize&(this->pageSize-1)))) {
+			throw std::runtime_error("TLB entries must be a multiple of the ways " \
+					"and pages a power of two");
+		}
+	}
+
+	bool Profiling() const {
+		return this->mrcRate!=0 || this->mrcMaxSamples!=0;
+	}
+
+	// every access goes through the one full-size cache in order
+	bool Direct() const {
+		return !this->pipelined && !this->Sampling() && !this->Profiling();
+	}
+
+	bool Sampling() const {
+		return this->sampleSetRatio!=0 || this->samplePeriod!=0;
 	}
 
 	void PrintStats() const {
@@ -125,6 +408,29 @@ struct CacheConfig {
 		}
 		std::cout << "Replacement Policy: " << p << std::endl;
 
+		std::string x;
+		switch (this->index) {
+		case Modulo:
+			x = "modulo";
+			break;
+		case XorFold:
+			x = "xor";
+			break;
+		case PrimeModulo:
+			x = "prime";
+			break;
+		case Skewed:
+			x = "skewed";
+			break;
+		default:
+			break;
+		}
+		std::cout << "Set Index: " << x << std::endl;
+		if (this->nWay >= ASSOC_WAYS && this->index!=Skewed) {
+			std::cout << "Tag Search: " <<
+				TagSearch::Name(std::min(this->simd, TagSearch::Best())) << std::endl;
+		}
+
 		std::string a;
 		switch (this->algo) {
 		case daxpy:
@@ -144,85 +450,67 @@ struct CacheConfig {
 		std::cout << "MXM Blocking Factor: " << this->blockFactor << std::endl;
 		std::cout << "Matrix or Vector dimension: " << this->matDims << std::endl;
 		std::cout << "Total Words: " << this->totalWords << std::endl;
+		std::cout << "Pipelined: " << (this->pipelined ? "yes" : "no") << std::endl;
+		if (this->victimEntries) {
+			std::cout << (this->missCache ? "Miss" : "Victim") << " Cache Entries: " <<
+				this->victimEntries << std::endl;
+		}
+		for (uint32_t cls=0; cls<CLASSES; ++cls) {
+			if (!this->catMasks[cls]) continue;
+			std::cout << "Way Mask " << ClassName(cls) << ": 0x" << std::hex <<
+				this->catMasks[cls] << std::dec << std::endl;
+		}
+		if (!this->restorePath.empty()) {
+			std::cout << "Restored From: " << this->restorePath << std::endl;
+		}
+		if (this->fastForward) {
+			std::cout << "Fast-forward: yes" << std::endl;
+		}
+		if (!this->sameBlockFilter) {
+			std::cout << "Same-block filter: no" << std::endl;
+		}
+		if (this->checkpointAt!=0) {
+			std::cout << "Checkpoint: " << this->checkpointPath <<
+				" at access " << this->checkpointAt << std::endl;
+		}
 	}
 };
 
-class Address {
+// Field sizes, masks and shifts for splitting an address, fixed
+// once the cache geometry is known. Owned by the RAM of each
+// simulator instance, so instances with different geometries can
+// coexist in one process.
+class AddressLayout {
 private:
+	friend class Address;
+
+	// field sizes in bits
+	uint32_t byteFieldSize_;
+	uint32_t wordFieldSize_;
+	uint32_t tagFieldSize_;
+	uint32_t indexFieldSize_;
+	uint32_t setFieldSize_;
+	uint32_t cacheBlockFieldSize_;
+	uint32_t ramBlockFieldSize_;
+
+	// masks for each field
+	uint32_t byteMask_;
+	uint32_t tagMask_;
+	uint32_t indexMask_;
+	uint32_t wordMask_;
+	uint32_t setMask_;
+	uint32_t cacheBlockMask_;
+	uint32_t ramBlockMask_;
+
+	// right shift factors
+	uint32_t wordShift_;
+	uint32_t setShift_;
+	uint32_t cacheBlockShift_;
+	uint32_t tagShift_;
+	uint32_t ramBlockShift_;
 
-
-	// field sizes in bits statically stored
-	// once cache size is known
-	static uint32_t byteFieldSize_;
-	static uint32_t wordFieldSize_;
-	static uint32_t tagFieldSize_;
-	static uint32_t indexFieldSize_;
-	static uint32_t setFieldSize_;
-	static uint32_t cacheBlockFieldSize_;
-	static uint32_t ramBlockFieldSize_;
-
-	// masks for each field statically
-	// stored once cache size is known
-	static uint32_t byteMask_;
-	static uint32_t tagMask_;
-	static uint32_t indexMask_;
-	static uint32_t wordMask_;
-	static uint32_t setMask_;
-	static uint32_t cacheBlockMask_;
-	static uint32_t ramBlockMask_;
-
-	// right shift factors statically stored
-	static uint32_t wordShift_;
-	static uint32_t setShift_;
-	static uint32_t cacheBlockShift_;
-	static uint32_t tagShift_;
-	static uint32_t ramBlockShift_;
 public:
-	const uint32_t address_;
-
-#ifndef NDEBUG
-	Address(uint32_t address) : address_(address) {	this->Assert();	}
-#else
-	Address(uint32_t address) : address_(address) {}
-#endif
-
-	Address (const Address& other) : address_(other.address_) {	}
-
-	Address (const Address&& other) : address_(std::move(other.address_)){ }
-
-	Address& operator=(const Address& other) = default;
-
-	Address& operator=(Address&& other) = default;
-
-	void PrintAddress() const {
-		std::cout << this->address_ << std::endl;
-	}
-
-	uint32_t GetTag() const {
-		return (this->address_&Address::tagMask_)>>Address::tagShift_;
-	}
-
-	uint32_t GetSet() const {
-		return (this->address_&Address::setMask_)>>Address::setShift_;
-	}
-
-	uint32_t GetCacheFullIndex() const {
-		return (this->address_&Address::indexMask_)>>Address::setShift_;
-	}
-
-	uint32_t GetCacheBlock() const {
-		return (this->address_&Address::cacheBlockMask_)>>Address::cacheBlockShift_;
-	}
-
-	uint32_t GetRamBlock() const {
-		return (this->address_&Address::ramBlockMask_)>>Address::ramBlockShift_;
-	}
-
-	uint32_t GetWord() const {
-		return (this->address_&Address::wordMask_)>>Address::wordShift_;
-	}
-
-	static void StaticInit(const CacheConfig& config) {
+	AddressLayout(const CacheConfig& config) {
 		indexFieldSize_ = GetBitLength(config.cacheBlockCount) - 1;
 		wordFieldSize_ = GetBitLength(config.wordsPerBlock) - 1;
 		setFieldSize_ = GetBitLength(config.numSets) - 1;
@@ -260,45 +548,79 @@ public:
 		std::cout << "cache tag mask:        " << std::bitset<ADDRLEN>(tagMask_) << std::endl;
 		std::cout << "ram block mask:        " << std::bitset<ADDRLEN>(ramBlockMask_) << std::endl;
 #endif
-		Address::Assert();
+		this->Assert();
 	}
 
-	static void Assert() {
-		assert(Address::indexFieldSize_!=0);
-		assert(Address::tagFieldSize_!=0);
-		assert(Address::tagMask_!=0);
-		assert(Address::indexMask_!=0);
+	void Assert() const {
+		assert(this->indexFieldSize_!=0);
+		assert(this->tagFieldSize_!=0);
+		assert(this->tagMask_!=0);
+		assert(this->indexMask_!=0);
 	}
 };
-uint32_t Address::byteFieldSize_ = 0;
-uint32_t Address::wordFieldSize_ = 0;
-uint32_t Address::tagFieldSize_ = 0;
-uint32_t Address::indexFieldSize_ = 0;
-uint32_t Address::byteMask_ = 0;
-uint32_t Address::wordMask_ = 0;
-uint32_t Address::tagMask_ = 0;
-uint32_t Address::indexMask_ = 0;
-uint32_t Address::setMask_ = 0;
-uint32_t Address::ramBlockMask_ = 0;
-uint32_t Address::cacheBlockMask_ = 0;
-uint32_t Address::setFieldSize_ = 0;
-uint32_t Address::cacheBlockFieldSize_ = 0;
-uint32_t Address::ramBlockFieldSize_ = 0;
-uint32_t Address::wordShift_ = 0;
-uint32_t Address::setShift_ = 0;
-uint32_t Address::cacheBlockShift_ = 0;
-uint32_t Address::tagShift_ = 0;
-uint32_t Address::ramBlockShift_ = 0;
 
-
-class DataBlock {
+class Address {
 private:
-	static uint32_t size_;
-	static uint32_t numWords_;
+	const AddressLayout * layout_;
+
+public:
+	const uint32_t address_;
+
+#ifndef NDEBUG
+	Address(uint32_t address, const AddressLayout& layout) :
+		layout_(&layout), address_(address) { this->layout_->Assert(); }
+#else
+	Address(uint32_t address, const AddressLayout& layout) :
+		layout_(&layout), address_(address) {}
+#endif
+
+	Address (const Address& other) : layout_(other.layout_), address_(other.address_) {	}
+
+	Address (const Address&& other) : layout_(other.layout_), address_(std::move(other.address_)){ }
+
+	Address& operator=(const Address& other) = default;
+
+	Address& operator=(Address&& other) = default;
+
+	void PrintAddress() const {
+		std::cout << this->address_ << std::endl;
+	}
+
+	uint32_t GetTag() const {
+		return (this->address_&this->layout_->tagMask_)>>this->layout_->tagShift_;
+	}
+
+	uint32_t GetSet() const {
+		return (this->address_&this->layout_->setMask_)>>this->layout_->setShift_;
+	}
+
+	uint32_t GetCacheFullIndex() const {
+		return (this->address_&this->layout_->indexMask_)>>this->layout_->setShift_;
+	}
+
+	uint32_t GetCacheBlock() const {
+		return (this->address_&this->layout_->cacheBlockMask_)>>this->layout_->cacheBlockShift_;
+	}
+
+	uint32_t GetRamBlock() const {
+		return (this->address_&this->layout_->ramBlockMask_)>>this->layout_->ramBlockShift_;
+	}
+
+	uint32_t GetWord() const {
+		return (this->address_&this->layout_->wordMask_)>>this->layout_->wordShift_;
+	}
+
+	// inverse of GetRamBlock: first byte of the block
+	static Address FromBlock(const uint32_t block, const AddressLayout& layout) {
+		return Address(block << layout.ramBlockShift_, layout);
+	}
+};
 
+
+class DataBlock {
 public:
 	std::vector<double> data_;
-	DataBlock() : data_(numWords_) { assert(this->size_!=0); }
+	DataBlock(const uint32_t numWords) : data_(numWords) {}
 	~DataBlock() { }
 	DataBlock(DataBlock&& other) : data_(std::move(other.data_)) {
 //		std::cout<<"Datablock move ctor called"<<std::endl;
@@ -313,33 +635,31 @@ public:
 	void SetWord(const uint32_t offset, const double value) {
 		this->data_[offset] = value;
 	}
-
-	static void StaticInit(const CacheConfig& config) {
-		DataBlock::size_ = config.blockSize;
-		DataBlock::numWords_ = config.wordsPerBlock;
-	}
-
-	static uint32_t GetSize() {
-		assert(DataBlock::size_!=0);
-		return DataBlock::size_;
-	}
 };
-uint32_t DataBlock::size_ = 0;
-uint32_t DataBlock::numWords_ = 0;
 
 
 class RAM {
 private:
 	const uint32_t size_;
+	const AddressLayout layout_;
 
 public:
 	std::vector<DataBlock> blocks_;
-	RAM(const CacheConfig& config) : size_(config.ramSize), blocks_(config.ramBlockCount) {}
+	RAM(const CacheConfig& config) : size_(config.ramSize), layout_(config),
+		blocks_(config.ramBlockCount, DataBlock(config.wordsPerBlock)) {}
+
+	const AddressLayout& GetLayout() const { return this->layout_; }
+
+	uint32_t GetSize() const { return this->size_; }
 
 	DataBlock GetBlockCopy(const Address& address) const {
 		return DataBlock(blocks_[address.GetRamBlock()]);
 	}
 
+	double GetWord(const Address& address) const {
+		return this->blocks_[address.GetRamBlock()].GetWord(address.GetWord());
+	}
+
 	void SetWord(const Address& address, const uint32_t offset, const double val) {
 		this->blocks_[address.GetRamBlock()].SetWord(offset, val);
 	}
@@ -352,9 +672,16 @@ protected:
 	struct CacheLine {
 		DataBlock dataBlock_;
 		const uint32_t tag_;
-		CacheLine(DataBlock& dataBlock, const uint32_t tag) : dataBlock_(dataBlock), tag_(tag) {}
-		CacheLine(const CacheLine& other) : dataBlock_(other.dataBlock_), tag_(other.tag_) {}
-		CacheLine(CacheLine&& other) : dataBlock_(other.dataBlock_), tag_(other.tag_) {}
+		// way the line occupies and the class that allocated it,
+		// both 0 unless the cache is partitioned
+		const uint32_t way_;
+		const uint32_t cls_;
+		CacheLine(DataBlock& dataBlock, const uint32_t tag, const uint32_t way,
+			const uint32_t cls) : dataBlock_(dataBlock), tag_(tag), way_(way), cls_(cls) {}
+		CacheLine(const CacheLine& other) : dataBlock_(other.dataBlock_), tag_(other.tag_),
+			way_(other.way_), cls_(other.cls_) {}
+		CacheLine(CacheLine&& other) : dataBlock_(other.dataBlock_), tag_(other.tag_),
+			way_(other.way_), cls_(other.cls_) {}
 		CacheLine& operator=(const CacheLine& other) = default;
 		CacheLine& operator=(CacheLine&& other) = default;
 		~CacheLine() { }
@@ -371,17 +698,306 @@ protected:
 	unsigned long long wmisses_;
 
 	RAM & ram_;
+	const CacheConfig::Policy policy_;
+	const CacheConfig::Index index_;
+	// set index function, fixed per configuration
+	const IndexFunction setIndex_;
+	// per-instance xorshift32 state so random replacement
+	// can be checkpointed and replayed exactly
+	uint32_t rng_;
 
 	std::vector< std::list<CacheLine> > blocks_;
 	std::vector< std::unordered_map<uint32_t, std::list<CacheLine>::iterator> > maps_;
 
+	// optional small fully-associative buffer probed on a miss
+	// before going to RAM. as a victim cache it holds lines evicted
+	// from the sets and swaps them back on a hit; as a miss cache it
+	// holds copies of recently missed lines. only block numbers are
+	// kept, line data is always re-read from RAM.
+	std::unique_ptr<TagCache> buffer_;
+	const bool missCache_;
+	unsigned long long bufferHits_;
+	unsigned long long bufferMisses_;
+
+	// same-block filter: the lines of the last few blocks touched,
+	// newest first, each kept only while it is still the last access
+	// to its set. a repeat access to such a line cannot change
+	// replacement state (it is already most recent in its set under
+	// LRU, FIFO and random ignore hits), so it is served without a
+	// set lookup. only a miss in the same set can evict the line, and
+	// that access drops the entry. skewed ways share no sets, so there
+	// the filter keeps just the last access.
+	struct Recent {
+		uint32_t block_;
+		uint32_t set_;
+		DataBlock * line_;
+	};
+	static uint32_t constexpr RECENT_ENTRIES = 4;
+	// the filter switches itself off for RECENT_IDLE windows of
+	// RECENT_WINDOW lookups whenever fewer than one lookup in
+	// RECENT_MIN_RATE hit during a window, as its upkeep then costs
+	// more than the lookups it saves
+	static uint32_t constexpr RECENT_WINDOW = 1 << 16;
+	static uint32_t constexpr RECENT_MIN_RATE = 8;
+	static uint32_t constexpr RECENT_IDLE = 16;
+	Recent recent_[RECENT_ENTRIES];
+	uint32_t nRecent_;
+	// configured entries, and those in use (0 while switched off)
+	const uint32_t recentEntries_;
+	uint32_t recentLimit_;
+	uint32_t recentProbes_;
+	uint32_t recentWindowHits_;
+	uint32_t recentIdle_;
+	unsigned long long recentHits_;
+	// resident lines, and lines displaced since the last reset
+	unsigned long long lines_;
+	unsigned long long evictions_;
+
+	// way partitioning: each access belongs to a class (by address
+	// region, else core 0) and may only allocate into the ways of
+	// its class's mask, while lookups still hit in any way. used_
+	// tracks the occupied ways of every set.
+	const bool partitioned_;
+	uint64_t masks_[CLASSES];
+	const uint32_t regionSize_;
+	std::vector<uint64_t> used_;
+	unsigned long long classLines_[CLASSES];
+	unsigned long long classMisses_[CLASSES];
+
 	Cache(const CacheConfig& config, RAM& ram) :
 		nWay_(config.nWay), cacheSize_(config.cacheSize),
 		blockSize_(config.blockSize), numBlocks_(config.cacheBlockCount),
 		numSets_(config.numSets), rhits_(0), rmisses_(0),
-		whits_(0), wmisses_(0), ram_(ram), blocks_(config.numSets), maps_(config.numSets) {
+		whits_(0), wmisses_(0), ram_(ram), policy_(config.policy),
+		index_(config.index),
+		setIndex_(config.numSets, config.index==CacheConfig::XorFold),
+		rng_(static_cast<uint32_t>(time(NULL)) | 1),
+		blocks_(config.numSets), maps_(config.numSets),
+		missCache_(config.missCache), bufferHits_(0), bufferMisses_(0),
+		nRecent_(0), recentEntries_(!config.sameBlockFilter ? 0 :
+				config.index==CacheConfig::Skewed ? 1 : RECENT_ENTRIES),
+		recentLimit_(recentEntries_), recentProbes_(0), recentWindowHits_(0),
+		recentIdle_(0),
+		recentHits_(0), lines_(0), evictions_(0),
+		partitioned_(config.Partitioned()), regionSize_(config.regionSize),
+		used_(partitioned_ ? config.numSets : 0, 0) {
+		const uint64_t all = this->nWay_ >= 64 ? ~0ull : (1ull << this->nWay_) - 1;
+		for (uint32_t cls=0; cls<CLASSES; ++cls) {
+			this->masks_[cls] = config.catMasks[cls] ? config.catMasks[cls] & all : all;
+			this->classLines_[cls] = 0;
+			this->classMisses_[cls] = 0;
+		}
+		if (config.victimEntries) {
+			this->buffer_ = std::unique_ptr<TagCache>{
+				new TagCache(1, config.victimEntries, TagCache::LRU) };
+		}
+	}
+
+	// a line whose block number is not resident any more
+	void Displaced(const uint32_t block) {
+		--this->lines_;
+		++this->evictions_;
+		if (this->buffer_ && !this->missCache_) {
+			this->buffer_->Fill(block);
+		}
+	}
+
+	// removes a line from a set, handing it to the victim buffer
+	void Evict(const uint32_t setIndex, std::list<CacheLine>::iterator it) {
+		std::list<CacheLine>& list = this->blocks_[setIndex];
+		std::unordered_map<uint32_t, std::list<CacheLine>::iterator>& map = this->maps_[setIndex];
+		const uint32_t evictedTag = it->tag_;
+		if (this->partitioned_) {
+			this->used_[setIndex] &= ~(1ull << it->way_);
+			--this->classLines_[it->cls_];
+		}
+		list.erase(it);
+#ifdef NDEBUG
+		map.erase(evictedTag);
+#else
+		int ret = map.erase(evictedTag);
+#endif
+		assert(ret==1);
+		assert(map.count(evictedTag)==0);
+		this->Displaced(evictedTag);
+	}
+
+	uint32_t ClassOf(const Address& address) const {
+		if (!this->partitioned_ || this->regionSize_==0) return 0;
+		const uint32_t region = address.address_ / this->regionSize_;
+		return region < MATS ? region + 1 : 0;
+	}
+
+	// the way a line of class cls is filled into in setIndex: a free
+	// way of the class if there is one, else the way of a victim
+	// among the lines the class may replace, the one nearest the
+	// back of the list (LRU, FIFO) or one at random. unpartitioned
+	// caches only evict once the set is full. the line is counted as
+	// resident from here.
+	uint32_t MakeRoom(const uint32_t setIndex, const uint32_t cls) {
+		std::list<CacheLine>& list = this->blocks_[setIndex];
+		const uint64_t mask = this->masks_[cls];
+		uint32_t way = 0;
+		if (this->partitioned_ && (mask & ~this->used_[setIndex])) {
+			way = __builtin_ctzll(mask & ~this->used_[setIndex]);
+		} else if (this->partitioned_ || list.size()==this->nWay_) {
+			std::list<CacheLine>::iterator victim = list.end();
+			if (this->policy_==CacheConfig::Random) {
+				uint32_t n = this->nWay_;
+				if (this->partitioned_) n = __builtin_popcountll(mask);
+				uint32_t pick = this->NextRandom()%n;
+				for (victim = list.begin(); ; ++victim) {
+					if (((mask >> victim->way_) & 1) && pick--==0) break;
+				}
+			} else {
+				do --victim; while (!((mask >> victim->way_) & 1));
+			}
+			way = victim->way_;
+			this->Evict(setIndex, victim);
+		}
+		++this->lines_;
+		if (this->partitioned_) {
+			this->used_[setIndex] |= 1ull << way;
+			++this->classLines_[cls];
+			++this->classMisses_[cls];
+		}
+		return way;
+	}
+
+	// called on every miss before the line is filled from RAM; looks
+	// the block up in the victim or miss buffer, taking it out of a
+	// victim buffer on a hit
+	void ProbeBuffer(const Address& address) {
+		if (!this->buffer_) return;
+		const uint32_t block = address.GetRamBlock();
+		if (this->missCache_) {
+			if (this->buffer_->Access(block)) ++this->bufferHits_;
+			else ++this->bufferMisses_;
+		} else if (this->buffer_->Remove(block)) {
+			// swap: the line moves back into its set and the
+			// line it displaces arrives here through Evict
+			++this->bufferHits_;
+		} else {
+			++this->bufferMisses_;
+		}
+	}
+
+	// records the access that just went through set: its entry moves
+	// to the front in place and replaces the set's older entry, if
+	// any, else the oldest one once the filter is full
+	void Touch(const uint32_t block, const uint32_t set, DataBlock& line) {
+		if (!this->recentLimit_) return;
+		uint32_t i = 0;
+		while (i<this->nRecent_ && this->recent_[i].set_!=set) ++i;
+		if (i==this->nRecent_) {
+			if (this->nRecent_ < this->recentLimit_) ++this->nRecent_;
+			i = this->nRecent_ - 1;
+		}
+		for (; i>0; --i) this->recent_[i] = this->recent_[i - 1];
+		this->recent_[0].block_ = block;
+		this->recent_[0].set_ = set;
+		this->recent_[0].line_ = &line;
+	}
+
+	// counts a filter lookup and, at the end of a window, switches
+	// the filter off or back on
+	void GateRecent(const bool hit) {
+		this->recentWindowHits_ += hit;
+		if (++this->recentProbes_ < RECENT_WINDOW) return;
+		if (this->recentLimit_) {
+			if (this->recentWindowHits_ * RECENT_MIN_RATE < RECENT_WINDOW) {
+				this->recentLimit_ = 0;
+				this->nRecent_ = 0;
+				this->recentIdle_ = 0;
+			}
+		} else if (++this->recentIdle_==RECENT_IDLE) {
+			this->recentLimit_ = this->recentEntries_;
+		}
+		this->recentProbes_ = 0;
+		this->recentWindowHits_ = 0;
+	}
+
+	DataBlock * FindRecent(const uint32_t block) const {
+		for (uint32_t i=0; i<this->nRecent_; ++i) {
+			if (this->recent_[i].block_==block) return this->recent_[i].line_;
+		}
+		return nullptr;
+	}
+
+	uint32_t NextRandom() {
+		uint32_t x = this->rng_;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return this->rng_ = x;
+	}
 
-		srand (time(NULL));
+	// Checkpoint layout: a fixed header, then one line count per
+	// set, then every resident tag (block number) set by set in list order (front
+	// first), which is the complete LRU/FIFO replacement state, then
+	// the way and class of each of those lines as way | class << 16,
+	// then the block numbers held by the victim or miss buffer, least
+	// recently used first. The cache is write-through, so there are
+	// no dirty bits, and line data is re-read from RAM on restore.
+	struct CheckpointHeader {
+		char magic_[8];
+		uint32_t version_;
+		uint32_t policy_;
+		uint32_t nWay_;
+		uint32_t numSets_;
+		uint32_t blockSize_;
+		uint32_t index_;
+		uint32_t rng_;
+		unsigned long long accesses_;
+		unsigned long long rhits_;
+		unsigned long long rmisses_;
+		unsigned long long whits_;
+		unsigned long long wmisses_;
+		unsigned long long bufferHits_;
+		unsigned long long bufferMisses_;
+		unsigned long long recentHits_;
+		unsigned long long classMisses_[CLASSES];
+		uint32_t bufferEntries_;
+		uint32_t missCache_;
+		uint32_t bufferLines_;
+	};
+
+	static uint32_t constexpr CHECKPOINT_VERSION = 4;
+
+	// appends the resident lines of set s in checkpoint order, as
+	// tags and way | class << 16
+	virtual void ExportSet(const uint32_t s, std::vector<uint32_t>& tags,
+			std::vector<uint32_t>& owners) const {
+		for (const CacheLine& line : this->blocks_[s]) {
+			tags.push_back(line.tag_);
+			owners.push_back(line.way_ | line.cls_ << 16);
+		}
+	}
+
+	// replaces set s with count lines in checkpoint order, reading
+	// their data from RAM; class occupancy starts from zero
+	virtual void ImportSet(const uint32_t s, const uint32_t * tags,
+			const uint32_t * owners, const uint32_t count) {
+		std::list<CacheLine>& list = this->blocks_[s];
+		std::unordered_map<uint32_t, std::list<CacheLine>::iterator>& map = this->maps_[s];
+		list.clear();
+		map.clear();
+		if (this->partitioned_) this->used_[s] = 0;
+		for (uint32_t i=0; i<count; ++i) {
+			DataBlock block(this->ram_.GetBlockCopy(Address::FromBlock(tags[i], this->ram_.GetLayout())));
+			uint32_t way = owners[i] & 0xFFFF;
+			const uint32_t cls = owners[i] >> 16;
+			// unpartitioned snapshots put every line in way 0
+			if (this->partitioned_ && ((this->used_[s] >> way) & 1)) {
+				way = __builtin_ctzll(~this->used_[s]);
+			}
+			list.push_back(CacheLine(block, tags[i], way, cls));
+			map[tags[i]] = std::prev(list.end());
+			if (this->partitioned_) {
+				this->used_[s] |= 1ull << way;
+				++this->classLines_[cls];
+			}
+		}
 	}
 
 public:
@@ -391,6 +1007,308 @@ public:
 	// factory pattern
 	static std::unique_ptr<Cache> Create(const CacheConfig& config, RAM& ram);
 
+	uint32_t SetOf(const uint32_t block) const {
+		return this->setIndex_(block);
+	}
+
+	unsigned long long GetMisses() const {
+		return this->rmisses_ + this->wmisses_;
+	}
+
+	// filter fast paths, non-virtual so batch consumers can try them
+	// before dispatching. both return false, touching nothing, unless
+	// address lies in the block the last access touched.
+	bool RecentGet(const Address& address, double& value) {
+		const DataBlock * line = this->FindRecent(address.GetRamBlock());
+		if (this->recentEntries_) this->GateRecent(line!=nullptr);
+		if (!line) return false;
+		++this->rhits_;
+		++this->recentHits_;
+		value = line->GetWord(address.GetWord());
+		return true;
+	}
+
+	bool RecentSet(const Address& address, const double val) {
+		DataBlock * line = this->FindRecent(address.GetRamBlock());
+		if (this->recentEntries_) this->GateRecent(line!=nullptr);
+		if (!line) return false;
+		++this->whits_;
+		++this->recentHits_;
+		this->ram_.SetWord(address, address.GetWord(), val);
+		line->SetWord(address.GetWord(), val);
+		return true;
+	}
+
+	bool InRecent(const uint32_t block) const {
+		return this->FindRecent(block)!=nullptr;
+	}
+
+	// counts a run of further accesses to a block in the filter whose
+	// data the caller does not need
+	void RecentRun(const uint32_t reads, const uint32_t writes) {
+		this->rhits_ += reads;
+		this->whits_ += writes;
+		this->recentHits_ += reads + writes;
+	}
+
+	unsigned long long GetEvictions() const { return this->evictions_; }
+	unsigned long long GetOccupancy() const { return this->lines_; }
+	unsigned long long GetBufferHits() const { return this->bufferHits_; }
+	unsigned long long GetReadHits() const { return this->rhits_; }
+	unsigned long long GetReadMisses() const { return this->rmisses_; }
+	unsigned long long GetWriteHits() const { return this->whits_; }
+	unsigned long long GetWriteMisses() const { return this->wmisses_; }
+
+	void ResetStats() {
+		this->recentHits_ = 0;
+		this->evictions_ = 0;
+		std::fill(this->classMisses_, this->classMisses_ + CLASSES, 0);
+		this->bufferHits_ = 0;
+		this->bufferMisses_ = 0;
+		this->rhits_ = 0;
+		this->rmisses_ = 0;
+		this->whits_ = 0;
+		this->wmisses_ = 0;
+	}
+
+	// the counters fast-forwarding extrapolates, in a fixed order
+	std::vector<unsigned long long> GetCounters() const {
+		std::vector<unsigned long long> v = { this->rhits_, this->rmisses_,
+			this->whits_, this->wmisses_, this->evictions_, this->recentHits_,
+			this->bufferHits_, this->bufferMisses_ };
+		v.insert(v.end(), this->classMisses_, this->classMisses_ + CLASSES);
+		return v;
+	}
+
+	// misses among counters in GetCounters() order
+	static unsigned long long MissesIn(const std::vector<unsigned long long>& counters) {
+		return counters[1] + counters[3];
+	}
+
+	// entries past those of GetCounters() belong to the caller
+	void SetCounters(const std::vector<unsigned long long>& counters) {
+		this->rhits_ = counters[0];
+		this->rmisses_ = counters[1];
+		this->whits_ = counters[2];
+		this->wmisses_ = counters[3];
+		this->evictions_ = counters[4];
+		this->recentHits_ = counters[5];
+		this->bufferHits_ = counters[6];
+		this->bufferMisses_ = counters[7];
+		std::copy(counters.begin() + 8, counters.begin() + 8 + CLASSES, this->classMisses_);
+	}
+
+	// hash of the replacement state with every block of a kernel
+	// array taken relative to bases[array], so two iterations that
+	// leave the same lines of their own rows and columns resident,
+	// grouped into sets alike and in the same recency order, hash
+	// alike. the per-set hashes are summed, since a shifted row
+	// lands in shifted sets. blocks outside the arrays are taken as
+	// they are.
+	uint64_t Fingerprint(const uint32_t (&bases)[MATS]) const {
+		const auto mix = [](uint64_t& h, const uint64_t v) {
+			h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+			h *= 0xff51afd7ed558ccdull;
+		};
+		const auto relative = [this, &bases](const uint32_t block) -> uint32_t {
+			if (this->regionSize_==0) return block;
+			const uint64_t region = static_cast<uint64_t>(block) * this->blockSize_ / this->regionSize_;
+			return region < MATS ? block - bases[region] : block;
+		};
+		uint64_t sum = 0;
+		std::vector<uint32_t> tags;
+		std::vector<uint32_t> owners;
+		for (uint32_t s=0; s<this->numSets_; ++s) {
+			tags.clear();
+			owners.clear();
+			this->ExportSet(s, tags, owners);
+			uint64_t h = 0;
+			for (size_t i=0; i<tags.size(); ++i) {
+				mix(h, relative(tags[i]));
+				mix(h, owners[i]);
+			}
+			sum += h;
+		}
+		uint64_t h = sum;
+		if (this->buffer_) {
+			for (const uint32_t key : this->buffer_->Keys()) mix(h, relative(key));
+		}
+		for (uint32_t i=0; i<this->nRecent_; ++i) mix(h, relative(this->recent_[i].block_));
+		// random replacement is only in the same state if its
+		// generator is, which in practice never recurs
+		if (this->policy_==CacheConfig::Random) mix(h, this->rng_);
+		return h;
+	}
+
+	// reloads every resident line from RAM after stores bypassed
+	// the cache
+	virtual void Resync() {
+		for (std::list<CacheLine>& list : this->blocks_) {
+			for (CacheLine& line : list) {
+				line.dataBlock_ = this->ram_.GetBlockCopy(
+						Address::FromBlock(line.tag_, this->ram_.GetLayout()));
+			}
+		}
+	}
+
+	void SaveCheckpoint(const char * path, const unsigned long long accesses) const {
+		CheckpointHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic_, "CSIMCKPT", sizeof(h.magic_));
+		h.version_ = CHECKPOINT_VERSION;
+		h.policy_ = this->policy_;
+		h.nWay_ = this->nWay_;
+		h.numSets_ = this->numSets_;
+		h.blockSize_ = this->blockSize_;
+		h.index_ = this->index_;
+		h.rng_ = this->rng_;
+		h.accesses_ = accesses;
+		h.rhits_ = this->rhits_;
+		h.rmisses_ = this->rmisses_;
+		h.whits_ = this->whits_;
+		h.wmisses_ = this->wmisses_;
+		h.bufferHits_ = this->bufferHits_;
+		h.bufferMisses_ = this->bufferMisses_;
+		h.recentHits_ = this->recentHits_;
+		std::copy(this->classMisses_, this->classMisses_ + CLASSES, h.classMisses_);
+		std::vector<uint32_t> buffered;
+		if (this->buffer_) {
+			buffered = this->buffer_->Keys();
+			h.bufferEntries_ = this->buffer_->GetWays();
+			h.missCache_ = this->missCache_;
+			h.bufferLines_ = buffered.size();
+		}
+
+		std::vector<uint32_t> counts;
+		std::vector<uint32_t> tags;
+		std::vector<uint32_t> owners;
+		counts.reserve(this->numSets_);
+		tags.reserve(this->numBlocks_);
+		owners.reserve(this->numBlocks_);
+		for (uint32_t s=0; s<this->numSets_; ++s) {
+			const size_t before = tags.size();
+			this->ExportSet(s, tags, owners);
+			counts.push_back(tags.size() - before);
+		}
+
+		FILE * f = fopen(path, "wb");
+		if (!f) throw std::runtime_error(std::string("cannot write checkpoint ") + path);
+		bool ok = fwrite(&h, sizeof(h), 1, f)==1 &&
+			fwrite(counts.data(), sizeof(uint32_t), counts.size(), f)==counts.size() &&
+			fwrite(tags.data(), sizeof(uint32_t), tags.size(), f)==tags.size() &&
+			fwrite(owners.data(), sizeof(uint32_t), owners.size(), f)==owners.size() &&
+			fwrite(buffered.data(), sizeof(uint32_t), buffered.size(), f)==buffered.size();
+		ok = fclose(f)==0 && ok;
+		if (!ok) throw std::runtime_error(std::string("short write to checkpoint ") + path);
+	}
+
+	// replaces the whole cache state with a snapshot; the file is
+	// mapped rather than read so large LLC snapshots are paged in
+	// lazily. returns the access count the snapshot was taken at.
+	unsigned long long LoadCheckpoint(const char * path) {
+		int fd = open(path, O_RDONLY);
+		if (fd < 0) throw std::runtime_error(std::string("cannot open checkpoint ") + path);
+		struct stat st;
+		if (fstat(fd, &st)!=0 || static_cast<size_t>(st.st_size) < sizeof(CheckpointHeader)) {
+			close(fd);
+			throw std::runtime_error(std::string("truncated checkpoint ") + path);
+		}
+		const size_t len = st.st_size;
+		void * mapped = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapped==MAP_FAILED) throw std::runtime_error(std::string("cannot map checkpoint ") + path);
+
+		const char * base = static_cast<const char *>(mapped);
+		CheckpointHeader h;
+		memcpy(&h, base, sizeof(h));
+		const char * error = nullptr;
+		if (memcmp(h.magic_, "CSIMCKPT", sizeof(h.magic_)) || h.version_!=CHECKPOINT_VERSION) {
+			error = "not a checkpoint: ";
+		} else if (h.policy_!=static_cast<uint32_t>(this->policy_) || h.nWay_!=this->nWay_ ||
+				h.numSets_!=this->numSets_ || h.blockSize_!=this->blockSize_ ||
+				h.index_!=static_cast<uint32_t>(this->index_) ||
+				h.bufferEntries_!=(this->buffer_ ? this->buffer_->GetWays() : 0) ||
+				(h.bufferEntries_ && h.missCache_!=static_cast<uint32_t>(this->missCache_))) {
+			error = "checkpoint geometry does not match configuration: ";
+		} else if (len < sizeof(h) + this->numSets_ * sizeof(uint32_t)) {
+			error = "truncated checkpoint ";
+		}
+
+		const uint32_t * counts = reinterpret_cast<const uint32_t *>(base + sizeof(h));
+		const uint32_t * tags = counts + this->numSets_;
+		size_t total = 0;
+		for (uint32_t s=0; !error && s<this->numSets_; ++s) {
+			if (counts[s] > this->nWay_) error = "corrupt checkpoint ";
+			total += counts[s];
+		}
+		if (!error && h.bufferLines_ > h.bufferEntries_) error = "corrupt checkpoint ";
+		if (!error && len < sizeof(h) +
+				(this->numSets_ + 2 * total + h.bufferLines_) * sizeof(uint32_t)) {
+			error = "truncated checkpoint ";
+		}
+		const uint32_t * owners = tags + total;
+		const uint32_t * buffered = owners + total;
+		for (size_t i=0; !error && i<total; ++i) {
+			if ((owners[i] & 0xFFFF) >= this->nWay_ || (owners[i] >> 16) >= CLASSES) {
+				error = "corrupt checkpoint ";
+			}
+		}
+		// every tag must be a block of this RAM that maps to its set,
+		// at most once; a snapshot of a larger problem fails here
+		// rather than reading past the RAM on import
+		const size_t ramBlocks = this->ram_.blocks_.size();
+		std::vector<uint32_t> set;
+		for (uint32_t s=0, first=0; !error && s<this->numSets_; first+=counts[s++]) {
+			set.assign(tags + first, tags + first + counts[s]);
+			for (const uint32_t tag : set) {
+				if (tag >= ramBlocks || this->SetOf(tag)!=s) {
+					error = "checkpoint does not match the simulated memory: ";
+				}
+			}
+			std::sort(set.begin(), set.end());
+			if (std::adjacent_find(set.begin(), set.end())!=set.end()) {
+				error = "corrupt checkpoint ";
+			}
+		}
+		if (!error) {
+			set.assign(buffered, buffered + h.bufferLines_);
+			std::sort(set.begin(), set.end());
+			if (std::adjacent_find(set.begin(), set.end())!=set.end() ||
+					(!set.empty() && set.back() >= ramBlocks)) {
+				error = "corrupt checkpoint ";
+			}
+		}
+		if (error) {
+			munmap(mapped, len);
+			throw std::runtime_error(std::string(error) + path);
+		}
+
+		this->nRecent_ = 0;
+		std::fill(this->classLines_, this->classLines_ + CLASSES, 0);
+		for (uint32_t s=0; s<this->numSets_; ++s) {
+			this->ImportSet(s, tags, owners, counts[s]);
+			tags += counts[s];
+			owners += counts[s];
+		}
+		this->lines_ = total;
+		if (this->buffer_) {
+			this->buffer_.reset(new TagCache(1, h.bufferEntries_, TagCache::LRU));
+			for (uint32_t i=0; i<h.bufferLines_; ++i) this->buffer_->Fill(buffered[i]);
+		}
+		munmap(mapped, len);
+
+		this->rng_ = h.rng_;
+		this->rhits_ = h.rhits_;
+		this->rmisses_ = h.rmisses_;
+		this->whits_ = h.whits_;
+		this->wmisses_ = h.wmisses_;
+		this->bufferHits_ = h.bufferHits_;
+		this->bufferMisses_ = h.bufferMisses_;
+		this->recentHits_ = h.recentHits_;
+		std::copy(h.classMisses_, h.classMisses_ + CLASSES, this->classMisses_);
+		return h.accesses_;
+	}
+
 	void PrintStats() const {
 		std::cout << "RESULTS" << std::string(25, '=') << std::endl;
 		std::cout << "Instruction Count: " <<
@@ -406,6 +1324,25 @@ public:
 		std::cout << "Write miss rate: " <<
 			static_cast<double>(this->wmisses_) / (this->whits_ + this->wmisses_)
 				<<std::endl;
+		if (this->recentEntries_) {
+			std::cout << "Same-block hits: " << this->recentHits_ << std::endl;
+		}
+		for (uint32_t cls=0; this->partitioned_ && cls<CLASSES; ++cls) {
+			std::cout << "Class " << CacheConfig::ClassName(cls) << " ways: 0x" <<
+				std::hex << this->masks_[cls] << std::dec << " occupancy: " <<
+				this->classLines_[cls] << " misses: " << this->classMisses_[cls] << std::endl;
+		}
+		if (this->buffer_) {
+			std::cout << (this->missCache_ ? "Miss" : "Victim") << " cache entries: " <<
+				this->buffer_->GetWays() << std::endl;
+			std::cout << (this->missCache_ ? "Miss" : "Victim") << " cache hits: " <<
+				this->bufferHits_ << std::endl;
+			std::cout << (this->missCache_ ? "Miss" : "Victim") << " cache misses: " <<
+				this->bufferMisses_ << std::endl;
+			std::cout << "Conflict misses saved: " << this->bufferHits_ << std::endl;
+			std::cout << "Misses to RAM: " <<
+				this->rmisses_ + this->wmisses_ - this->bufferHits_ << std::endl;
+		}
 	}
 };
 
@@ -414,8 +1351,10 @@ public:
 	LRUCache(const CacheConfig& config, RAM& ram) : Cache(config, ram) {};
 
 	double GetDouble(const Address& address) {
-		uint32_t setIndex = address.GetSet();
-		uint32_t tag = address.GetTag();
+		double value;
+		if (this->RecentGet(address, value)) return value;
+		uint32_t tag = address.GetRamBlock();
+		uint32_t setIndex = this->SetOf(tag);
 		std::list<CacheLine>& list = this->blocks_[setIndex];
 		std::unordered_map<uint32_t, std::list<CacheLine>::iterator>& map = this->maps_[setIndex];
 
@@ -429,42 +1368,37 @@ public:
 			list.push_front(cl);
 			// update the stored iterator
 			map[tag] = list.begin();
+			this->Touch(tag, setIndex, list.front().dataBlock_);
 			assert(this->ram_.blocks_[address.GetRamBlock()].GetWord(address.GetWord())==cl.dataBlock_.GetWord(address.GetWord()));
 			return cl.dataBlock_.GetWord(address.GetWord());
 		}
 
 		// cache miss: fetch from RAM.
 		++this->rmisses_;
+		this->ProbeBuffer(address);
 
-		if (list.size() == this->nWay_) {
-			// need to evict back of list (LRU)
-			CacheLine& evicted = list.back();
-			list.pop_back();
-#ifdef NDEBUG
-			map.erase(evicted.tag_);
-#else
-			int ret = map.erase(evicted.tag_);
-#endif
-			assert(ret==1);
-			assert(map.count(evicted.tag_)==0);
-		}
+		// evicts the back of the list (LRU) if the class has no free way
+		const uint32_t cls = this->ClassOf(address);
+		const uint32_t way = this->MakeRoom(setIndex, cls);
 		// Note: copy constructor is called.
 		// a copied block from the one in RAM.
 		DataBlock newBlock(this->ram_.GetBlockCopy(address));
 		// Note: this cacheline holds a reference
 		// to this the copied block
-		CacheLine line(newBlock, address.GetTag());
+		CacheLine line(newBlock, tag, way, cls);
 		assert(line.dataBlock_.GetWord(address.GetWord())
 				==newBlock.GetWord(address.GetWord()));
 		list.push_front(line);
 		// update the map with new block
 		map[tag] = list.begin();
+		this->Touch(tag, setIndex, list.front().dataBlock_);
 		return line.dataBlock_.GetWord(address.GetWord());
 	}
 
 	void SetDouble(const Address& address, const double val) {
-		uint32_t setIndex = address.GetSet();
-		uint32_t tag = address.GetTag();
+		if (this->RecentSet(address, val)) return;
+		uint32_t tag = address.GetRamBlock();
+		uint32_t setIndex = this->SetOf(tag);
 		uint32_t wordIndex = address.GetWord();
 		std::list<CacheLine>& list = this->blocks_[setIndex];
 		assert(list.size() <= this->nWay_);
@@ -485,29 +1419,23 @@ public:
 			list.erase(hit->second);
 			list.push_front(cl);
 			map[tag] = list.begin();
+			this->Touch(tag, setIndex, list.front().dataBlock_);
 			return;
 		}
 		// cache miss, bring in the new block from ram
 		++this->wmisses_;
-		if (list.size() == this->nWay_) {
-			// need to evict back of list (LRU)
-			CacheLine& evicted = list.back();
-			list.pop_back();
-#ifdef NDEBUG
-			map.erase(evicted.tag_);
-#else
-			int ret = map.erase(evicted.tag_);
-#endif
-			assert(ret==1);
-			assert(map.count(evicted.tag_)==0);
-		}
+		this->ProbeBuffer(address);
+		// evicts the back of the list (LRU) if the class has no free way
+		const uint32_t cls = this->ClassOf(address);
+		const uint32_t way = this->MakeRoom(setIndex, cls);
 		DataBlock newBlock(this->ram_.GetBlockCopy(address));
-		CacheLine line(newBlock, address.GetTag());
+		CacheLine line(newBlock, tag, way, cls);
 		assert(newBlock.GetWord(address.GetWord())==val);
 		assert(line.dataBlock_.GetWord(address.GetWord())==val);
 		list.push_front(line);
 		// update the map with new block
 		map[tag] = list.begin();
+		this->Touch(tag, setIndex, list.front().dataBlock_);
 		assert(list.size()<=this->nWay_);
 		return;
 	}
@@ -518,8 +1446,9 @@ public:
 	FIFOCache(const CacheConfig& config, RAM& ram) : Cache(config, ram) {};
 private:
 	void SetDouble(const Address& address, const double val) {
-		uint32_t setIndex = address.GetSet();
-		uint32_t tag = address.GetTag();
+		if (this->RecentSet(address, val)) return;
+		uint32_t tag = address.GetRamBlock();
+		uint32_t setIndex = this->SetOf(tag);
 		uint32_t wordIndex = address.GetWord();
 		std::list<CacheLine>& list = this->blocks_[setIndex];
 		assert(list.size() <= this->nWay_);
@@ -535,38 +1464,34 @@ private:
 			// dont bother reordering the queue since its FIFO
 			++this->whits_;
 			hit->second->dataBlock_.SetWord(wordIndex, val);
+			this->Touch(tag, setIndex, hit->second->dataBlock_);
 			assert(hit->second->dataBlock_.GetWord(wordIndex)==val);
 			return;
 		}
 		// **** CACHE MISS ****
 		// cache miss, bring in the new block from ram
 		++this->wmisses_;
-		if (list.size() == this->nWay_) {
-			// need to evict back of list (FIFO)
-			CacheLine& evicted = list.back();
-			list.pop_back();
-#ifdef NDEBUG
-			map.erase(evicted.tag_);
-#else
-			int ret = map.erase(evicted.tag_);
-#endif
-			assert(ret==1);
-			assert(map.count(evicted.tag_)==0);
-		}
+		this->ProbeBuffer(address);
+		// evicts the back of the list (FIFO) if the class has no free way
+		const uint32_t cls = this->ClassOf(address);
+		const uint32_t way = this->MakeRoom(setIndex, cls);
 		DataBlock newBlock(this->ram_.GetBlockCopy(address));
-		CacheLine line(newBlock, address.GetTag());
+		CacheLine line(newBlock, tag, way, cls);
 		assert(newBlock.GetWord(address.GetWord())==val);
 		assert(line.dataBlock_.GetWord(address.GetWord())==val);
 		list.push_front(line);
 		// update the map with new block
 		map[tag] = list.begin();
+		this->Touch(tag, setIndex, list.front().dataBlock_);
 		assert(list.size()<=this->nWay_);
 		return;
 	}
 
 	double GetDouble(const Address& address) {
-		uint32_t setIndex = address.GetSet();
-		uint32_t tag = address.GetTag();
+		double value;
+		if (this->RecentGet(address, value)) return value;
+		uint32_t tag = address.GetRamBlock();
+		uint32_t setIndex = this->SetOf(tag);
 		std::list<CacheLine>& list = this->blocks_[setIndex];
 		std::unordered_map<uint32_t, std::list<CacheLine>::iterator>& map = this->maps_[setIndex];
 
@@ -577,33 +1502,27 @@ private:
 			++this->rhits_;
 			assert(this->ram_.blocks_[address.GetRamBlock()].GetWord(address.GetWord())==
 					hit->second->dataBlock_.GetWord(address.GetWord()));
+			this->Touch(tag, setIndex, hit->second->dataBlock_);
 			return hit->second->dataBlock_.GetWord(address.GetWord());
 		}
 
 		// *** CACHE LOAD MISS ***
 		// cache miss: fetch from RAM.
 		++this->rmisses_;
+		this->ProbeBuffer(address);
 
-		if (list.size() == this->nWay_) {
-			// need to evict back of list (FIFO)
-			CacheLine& evicted = list.back();
-			list.pop_back();
-#ifdef NDEBUG
-			map.erase(evicted.tag_);
-#else
-			int ret = map.erase(evicted.tag_);
-#endif
-			assert(ret==1);
-			assert(map.count(evicted.tag_)==0);
-		}
+		// evicts the back of the list (FIFO) if the class has no free way
+		const uint32_t cls = this->ClassOf(address);
+		const uint32_t way = this->MakeRoom(setIndex, cls);
 		// Note: copy constructor is called.
 		// a copied block from the one in RAM.
 		DataBlock newBlock(this->ram_.GetBlockCopy(address));
-		CacheLine line(newBlock, address.GetTag());
+		CacheLine line(newBlock, tag, way, cls);
 		assert(line.dataBlock_.GetWord(address.GetWord())==newBlock.GetWord(address.GetWord()));
 		list.push_front(line);
 		// update the map with new block
 		map[tag] = list.begin();
+		this->Touch(tag, setIndex, list.front().dataBlock_);
 		return line.dataBlock_.GetWord(address.GetWord());
 	}
 };
@@ -614,8 +1533,9 @@ public:
 private:
 
 	void SetDouble(const Address& address, const double val) {
-		uint32_t setIndex = address.GetSet();
-		uint32_t tag = address.GetTag();
+		if (this->RecentSet(address, val)) return;
+		uint32_t tag = address.GetRamBlock();
+		uint32_t setIndex = this->SetOf(tag);
 		uint32_t wordIndex = address.GetWord();
 		std::list<CacheLine>& list = this->blocks_[setIndex];
 		assert(list.size() <= this->nWay_);
@@ -631,40 +1551,34 @@ private:
 			// dont bother reordering the queue since its FIFO
 			++this->whits_;
 			hit->second->dataBlock_.SetWord(wordIndex, val);
+			this->Touch(tag, setIndex, hit->second->dataBlock_);
 			assert(hit->second->dataBlock_.GetWord(wordIndex)==val);
 			return;
 		}
 		// **** CACHE MISS ****
 		// cache miss, bring in the new block from ram
 		++this->wmisses_;
-		if (list.size() == this->nWay_) {
-			// evict block at random
-			std::list<CacheLine>::iterator it = list.begin();
-			for (uint32_t i=0; i<rand()%this->nWay_; ++i) ++it;
-			CacheLine& evicted = *it;
-			list.erase(it);
-#ifdef NDEBUG
-			map.erase(evicted.tag_);
-#else
-			int ret = map.erase(evicted.tag_);
-#endif
-			assert(ret==1);
-			assert(map.count(evicted.tag_)==0);
-		}
+		this->ProbeBuffer(address);
+		// evicts a block at random if the class has no free way
+		const uint32_t cls = this->ClassOf(address);
+		const uint32_t way = this->MakeRoom(setIndex, cls);
 		DataBlock newBlock(this->ram_.GetBlockCopy(address));
-		CacheLine line(newBlock, address.GetTag());
+		CacheLine line(newBlock, tag, way, cls);
 		assert(newBlock.GetWord(address.GetWord())==val);
 		assert(line.dataBlock_.GetWord(address.GetWord())==val);
 		list.push_front(line);
 		// update the map with new block
 		map[tag] = list.begin();
+		this->Touch(tag, setIndex, list.front().dataBlock_);
 		assert(list.size()<=this->nWay_);
 		return;
 	}
 
 	double GetDouble(const Address& address) {
-		uint32_t setIndex = address.GetSet();
-		uint32_t tag = address.GetTag();
+		double value;
+		if (this->RecentGet(address, value)) return value;
+		uint32_t tag = address.GetRamBlock();
+		uint32_t setIndex = this->SetOf(tag);
 		std::list<CacheLine>& list = this->blocks_[setIndex];
 		std::unordered_map<uint32_t, std::list<CacheLine>::iterator>& map = this->maps_[setIndex];
 
@@ -675,41 +1589,374 @@ private:
 			++this->rhits_;
 			assert(this->ram_.blocks_[address.GetRamBlock()].GetWord(address.GetWord())==
 					hit->second->dataBlock_.GetWord(address.GetWord()));
+			this->Touch(tag, setIndex, hit->second->dataBlock_);
 			return hit->second->dataBlock_.GetWord(address.GetWord());
 		}
 
 		// *** CACHE LOAD MISS ***
 		// cache miss: fetch from RAM.
 		++this->rmisses_;
+		this->ProbeBuffer(address);
 
-		if (list.size() == this->nWay_) {
-			// evict block at random
-			std::list<CacheLine>::iterator it = list.begin();
-			for (uint32_t i=0; i<rand()%this->nWay_; ++i) ++it;
-			CacheLine& evicted = *it;
-			list.erase(it);
-#ifdef NDEBUG
-			map.erase(evicted.tag_);
-#else
-			int ret = map.erase(evicted.tag_);
-#endif
-			assert(ret==1);
-			assert(map.count(evicted.tag_)==0);
-		}
+		// evicts a block at random if the class has no free way
+		const uint32_t cls = this->ClassOf(address);
+		const uint32_t way = this->MakeRoom(setIndex, cls);
 		// Note: copy constructor is called.
 		// a copied block from the one in RAM.
 		DataBlock newBlock(this->ram_.GetBlockCopy(address));
-		CacheLine line(newBlock, address.GetTag());
+		CacheLine line(newBlock, tag, way, cls);
 		assert(line.dataBlock_.GetWord(address.GetWord())==newBlock.GetWord(address.GetWord()));
 		list.push_front(line);
 		// update the map with new block
 		map[tag] = list.begin();
+		this->Touch(tag, setIndex, list.front().dataBlock_);
 		return line.dataBlock_.GetWord(address.GetWord());
 	}
 };
 
-std::unique_ptr<Cache> Cache::Create(const CacheConfig& config, RAM& ram) {
-	if (config.policy == config.LRU) {
+// Skewed-associative organization: every way is a direct-mapped
+// bank indexed by its own hash of the block number, so blocks that
+// conflict in one way are spread apart in the others. Replacement
+// picks among the nWay candidate slots of the block: the oldest
+// stamp for LRU (refreshed on hits) and FIFO, or one at random.
+class SkewedCache : public Cache {
+private:
+	struct Slot {
+		DataBlock dataBlock_;
+		uint32_t tag_;
+		uint32_t cls_;
+		// 0 marks an empty slot
+		unsigned long long stamp_;
+	};
+
+	std::vector< std::vector<Slot> > ways_;
+	std::vector<uint32_t> seeds_;
+	unsigned long long clock_;
+
+	uint32_t SlotOf(const uint32_t way, const uint32_t block) const {
+		uint32_t h = (block ^ this->seeds_[way]) * 0x9e3779b1u;
+		h ^= h >> 15;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		return this->setIndex_.mod_(h);
+	}
+
+	Slot * Find(const uint32_t block) {
+		for (uint32_t w=0; w<this->nWay_; ++w) {
+			Slot& slot = this->ways_[w][this->SlotOf(w, block)];
+			if (slot.stamp_!=0 && slot.tag_==block) return &slot;
+		}
+		return nullptr;
+	}
+
+	Slot& Fill(const Address& address, const uint32_t block) {
+		this->ProbeBuffer(address);
+		// a class only allocates into the ways of its mask
+		const uint32_t cls = this->ClassOf(address);
+		const uint64_t mask = this->masks_[cls];
+		Slot * victim = nullptr;
+		for (uint32_t w=0; w<this->nWay_; ++w) {
+			if (!((mask >> w) & 1)) continue;
+			Slot& slot = this->ways_[w][this->SlotOf(w, block)];
+			if (slot.stamp_==0) {
+				victim = &slot;
+				break;
+			}
+			if (!victim || slot.stamp_ < victim->stamp_) victim = &slot;
+		}
+		if (victim->stamp_!=0 && this->policy_==CacheConfig::Random) {
+			uint32_t n = this->nWay_;
+			if (this->partitioned_) n = __builtin_popcountll(mask);
+			uint32_t pick = this->NextRandom()%n;
+			uint32_t w = 0;
+			for (; !((mask >> w) & 1) || pick--!=0; ++w) {}
+			victim = &this->ways_[w][this->SlotOf(w, block)];
+		}
+		if (victim->stamp_!=0) {
+			this->Displaced(victim->tag_);
+			if (this->partitioned_) --this->classLines_[victim->cls_];
+		}
+		++this->lines_;
+		if (this->partitioned_) {
+			++this->classLines_[cls];
+			++this->classMisses_[cls];
+		}
+		victim->dataBlock_ = this->ram_.GetBlockCopy(address);
+		victim->tag_ = block;
+		victim->cls_ = cls;
+		victim->stamp_ = ++this->clock_;
+		this->Touch(block, 0, victim->dataBlock_);
+		return *victim;
+	}
+
+public:
+	SkewedCache(const CacheConfig& config, RAM& ram) : Cache(config, ram),
+		ways_(config.nWay), seeds_(config.nWay), clock_(0) {
+		for (uint32_t w=0; w<this->nWay_; ++w) {
+			Slot empty = { DataBlock(0), 0, 0, 0 };
+			this->ways_[w].assign(this->numSets_, empty);
+			this->seeds_[w] = 0x6a09e667u * (2*w + 1);
+		}
+	}
+
+	double GetDouble(const Address& address) {
+		double value;
+		if (this->RecentGet(address, value)) return value;
+		const uint32_t block = address.GetRamBlock();
+		Slot * hit = this->Find(block);
+		if (hit) {
+			++this->rhits_;
+			if (this->policy_==CacheConfig::LRU) hit->stamp_ = ++this->clock_;
+			this->Touch(block, 0, hit->dataBlock_);
+			return hit->dataBlock_.GetWord(address.GetWord());
+		}
+		++this->rmisses_;
+		return this->Fill(address, block).dataBlock_.GetWord(address.GetWord());
+	}
+
+	void SetDouble(const Address& address, const double val) {
+		if (this->RecentSet(address, val)) return;
+		const uint32_t block = address.GetRamBlock();
+		const uint32_t wordIndex = address.GetWord();
+		// write through + write allocate
+		this->ram_.SetWord(address, wordIndex, val);
+		Slot * hit = this->Find(block);
+		if (hit) {
+			++this->whits_;
+			if (this->policy_==CacheConfig::LRU) hit->stamp_ = ++this->clock_;
+			hit->dataBlock_.SetWord(wordIndex, val);
+			this->Touch(block, 0, hit->dataBlock_);
+			return;
+		}
+		++this->wmisses_;
+		this->Fill(address, block);
+	}
+
+	void Resync() {
+		for (std::vector<Slot>& way : this->ways_) {
+			for (Slot& slot : way) {
+				if (slot.stamp_==0) continue;
+				slot.dataBlock_ = this->ram_.GetBlockCopy(
+						Address::FromBlock(slot.tag_, this->ram_.GetLayout()));
+			}
+		}
+	}
+};
+
+// Engine for wide sets, up to fully associative. Each set keeps
+// its tags, ages and lines in flat arrays, so a lookup is one
+// vectorized compare over nWay contiguous tags instead of a hash
+// probe and a list splice. A way's age is the set's clock at its
+// last use (LRU) or fill (FIFO), 0 while the way is empty, so the
+// way to fill is the minimum age among the ways the access's class
+// may allocate into: an empty one first, else the LRU/FIFO victim,
+// exactly the choices of the list engines. Random replacement picks
+// among those ways once none is empty. Sets of HINT_WAYS or more also
+// keep a small direct-mapped table of the way each block was last
+// found in, checked before the scan; a stale hint only costs the scan.
+class AssocCache : public Cache {
+private:
+	static uint32_t constexpr HINT_WAYS = 128;
+
+	const TagSearch search_;
+	std::vector<uint32_t> tags_;
+	std::vector<uint32_t> ages_;
+	std::vector<uint32_t> owners_;
+	std::vector<DataBlock> data_;
+	std::vector<uint32_t> clocks_;
+	// per class, 0 for the ways it may allocate into and ~0 for the
+	// rest, or'ed into the ages so the minimum skips them
+	std::vector<uint32_t> bias_[CLASSES];
+	// 2^hintBits_ hints per set, none when hintBits_ is 0
+	const uint32_t hintBits_;
+	std::vector<uint32_t> hints_;
+
+	size_t Base(const uint32_t setIndex) const {
+		return static_cast<size_t>(setIndex) * this->nWay_;
+	}
+
+	uint32_t& Hint(const uint32_t setIndex, const uint32_t block) {
+		return this->hints_[(static_cast<size_t>(setIndex) << this->hintBits_) +
+			((block * 0x9e3779b1u) >> (32 - this->hintBits_))];
+	}
+
+	// way of block in setIndex, or -1
+	int Lookup(const uint32_t setIndex, const uint32_t block) {
+		const size_t base = this->Base(setIndex);
+		if (!this->hintBits_) return this->search_.Find(&this->tags_[base], this->nWay_, block);
+		uint32_t& hint = this->Hint(setIndex, block);
+		if (this->tags_[base + hint]==block) return hint;
+		const int way = this->search_.Find(&this->tags_[base], this->nWay_, block);
+		if (way >= 0) hint = way;
+		return way;
+	}
+
+	// next age in setIndex; when the clock runs out the ages are
+	// renumbered 1.. in their order, which keeps every decision
+	uint32_t Tick(const uint32_t setIndex) {
+		if (this->clocks_[setIndex]==TagSearch::INVALID - 1) {
+			uint32_t * ages = &this->ages_[this->Base(setIndex)];
+			std::vector<uint32_t> order;
+			for (uint32_t w=0; w<this->nWay_; ++w) {
+				if (ages[w]) order.push_back(w);
+			}
+			std::sort(order.begin(), order.end(), [ages](uint32_t x, uint32_t y) {
+				return ages[x] < ages[y];
+			});
+			for (uint32_t i=0; i<order.size(); ++i) ages[order[i]] = i + 1;
+			this->clocks_[setIndex] = order.size();
+		}
+		return ++this->clocks_[setIndex];
+	}
+
+	size_t Fill(const Address& address, const uint32_t block, const uint32_t setIndex) {
+		this->ProbeBuffer(address);
+		const uint32_t cls = this->ClassOf(address);
+		const size_t base = this->Base(setIndex);
+		uint32_t way = this->search_.Oldest(&this->ages_[base],
+				this->bias_[cls].data(), this->nWay_);
+		if (this->ages_[base + way]!=0 && this->policy_==CacheConfig::Random) {
+			if (this->partitioned_) {
+				const uint64_t mask = this->masks_[cls];
+				uint32_t pick = this->NextRandom()%__builtin_popcountll(mask);
+				for (way = 0; !((mask >> way) & 1) || pick--!=0; ++way) {}
+			} else {
+				way = this->NextRandom()%this->nWay_;
+			}
+		}
+		const size_t i = base + way;
+		if (this->ages_[i]!=0) {
+			this->Displaced(this->tags_[i]);
+			if (this->partitioned_) --this->classLines_[this->owners_[i]];
+		}
+		++this->lines_;
+		if (this->partitioned_) {
+			++this->classLines_[cls];
+			++this->classMisses_[cls];
+		}
+		this->data_[i] = this->ram_.GetBlockCopy(address);
+		this->tags_[i] = block;
+		this->owners_[i] = cls;
+		this->ages_[i] = this->Tick(setIndex);
+		if (this->hintBits_) this->Hint(setIndex, block) = way;
+		this->Touch(block, setIndex, this->data_[i]);
+		return i;
+	}
+
+	void ExportSet(const uint32_t s, std::vector<uint32_t>& tags,
+			std::vector<uint32_t>& owners) const {
+		// most recently used (LRU) or filled (FIFO) first, like
+		// the list engines
+		const size_t base = this->Base(s);
+		std::vector<uint32_t> order;
+		for (uint32_t w=0; w<this->nWay_; ++w) {
+			if (this->ages_[base + w]) order.push_back(w);
+		}
+		const uint32_t * ages = &this->ages_[base];
+		std::sort(order.begin(), order.end(), [ages](uint32_t x, uint32_t y) {
+			return ages[x] > ages[y];
+		});
+		// unpartitioned caches record way 0 for every line, as the
+		// list engines do
+		for (const uint32_t w : order) {
+			tags.push_back(this->tags_[base + w]);
+			owners.push_back((this->partitioned_ ? w : 0) | this->owners_[base + w] << 16);
+		}
+	}
+
+	void ImportSet(const uint32_t s, const uint32_t * tags,
+			const uint32_t * owners, const uint32_t count) {
+		const size_t base = this->Base(s);
+		std::fill(this->tags_.begin() + base, this->tags_.begin() + base + this->nWay_,
+				static_cast<uint32_t>(TagSearch::INVALID));
+		std::fill(this->ages_.begin() + base, this->ages_.begin() + base + this->nWay_, 0);
+		for (uint32_t i=0; i<count; ++i) {
+			// recorded ways only matter to partitioned caches; an
+			// unpartitioned one fills in list order
+			uint32_t way = this->partitioned_ ? owners[i] & 0xFFFF : i;
+			if (this->ages_[base + way]) {
+				way = this->search_.Find(&this->ages_[base], this->nWay_, 0);
+			}
+			const size_t j = base + way;
+			this->data_[j] = this->ram_.GetBlockCopy(Address::FromBlock(tags[i], this->ram_.GetLayout()));
+			this->tags_[j] = tags[i];
+			this->owners_[j] = owners[i] >> 16;
+			this->ages_[j] = count - i;
+			if (this->partitioned_) ++this->classLines_[this->owners_[j]];
+		}
+		this->clocks_[s] = count;
+	}
+
+public:
+	AssocCache(const CacheConfig& config, RAM& ram) : Cache(config, ram),
+		search_(config.simd),
+		tags_(static_cast<size_t>(config.numSets) * config.nWay,
+				static_cast<uint32_t>(TagSearch::INVALID)),
+		ages_(tags_.size(), 0), owners_(tags_.size(), 0),
+		data_(tags_.size(), DataBlock(config.wordsPerBlock)),
+		clocks_(config.numSets, 0),
+		hintBits_(config.nWay >= HINT_WAYS ? GetBitLength(config.nWay) : 0),
+		hints_(hintBits_ ? static_cast<size_t>(config.numSets) << hintBits_ : 0, 0) {
+		for (uint32_t cls=0; cls<CLASSES; ++cls) {
+			this->bias_[cls].assign(this->nWay_, 0);
+			for (uint32_t w=0; this->partitioned_ && w<this->nWay_; ++w) {
+				if (!((this->masks_[cls] >> w) & 1)) this->bias_[cls][w] = TagSearch::INVALID;
+			}
+		}
+	}
+
+	double GetDouble(const Address& address) {
+		double value;
+		if (this->RecentGet(address, value)) return value;
+		const uint32_t block = address.GetRamBlock();
+		const uint32_t setIndex = this->SetOf(block);
+		const size_t base = this->Base(setIndex);
+		const int way = this->Lookup(setIndex, block);
+		if (way >= 0) {
+			++this->rhits_;
+			if (this->policy_==CacheConfig::LRU) this->ages_[base + way] = this->Tick(setIndex);
+			this->Touch(block, setIndex, this->data_[base + way]);
+			return this->data_[base + way].GetWord(address.GetWord());
+		}
+		++this->rmisses_;
+		return this->data_[this->Fill(address, block, setIndex)].GetWord(address.GetWord());
+	}
+
+	void SetDouble(const Address& address, const double val) {
+		if (this->RecentSet(address, val)) return;
+		const uint32_t block = address.GetRamBlock();
+		const uint32_t wordIndex = address.GetWord();
+		// write through + write allocate
+		this->ram_.SetWord(address, wordIndex, val);
+		const uint32_t setIndex = this->SetOf(block);
+		const size_t base = this->Base(setIndex);
+		const int way = this->Lookup(setIndex, block);
+		if (way >= 0) {
+			++this->whits_;
+			if (this->policy_==CacheConfig::LRU) this->ages_[base + way] = this->Tick(setIndex);
+			this->data_[base + way].SetWord(wordIndex, val);
+			this->Touch(block, setIndex, this->data_[base + way]);
+			return;
+		}
+		++this->wmisses_;
+		this->Fill(address, block, setIndex);
+	}
+
+	void Resync() {
+		for (size_t i=0; i<this->tags_.size(); ++i) {
+			if (this->ages_[i]==0) continue;
+			this->data_[i] = this->ram_.GetBlockCopy(
+					Address::FromBlock(this->tags_[i], this->ram_.GetLayout()));
+		}
+	}
+};
+
+inline std::unique_ptr<Cache> Cache::Create(const CacheConfig& config, RAM& ram) {
+	if (config.index == config.Skewed) {
+		return std::unique_ptr<Cache> { new SkewedCache(config, ram) };
+	} else if (config.nWay >= CacheConfig::ASSOC_WAYS) {
+		return std::unique_ptr<Cache> { new AssocCache(config, ram) };
+	} else if (config.policy == config.LRU) {
 		return std::unique_ptr<Cache> { new LRUCache(config, ram) };
 	} else if (config.policy == config.FIFO) {
 		return std::unique_ptr<Cache> { new FIFOCache(config, ram) };
@@ -720,18 +1967,209 @@ std::unique_ptr<Cache> Cache::Create(const CacheConfig& config, RAM& ram) {
 }
 
 
+// one load or store as seen by the workload. in pipelined mode
+// these are produced by the kernel thread and replayed against
+// the cache by the consumer thread.
+struct AccessRecord {
+	uint32_t address_;
+	uint32_t write_;
+	double value_;
+};
+
+// Runs the cache engine on its own thread. The workload thread
+// stages records locally and publishes them to a lock-free SPSC
+// ring in batches; the consumer drains the ring in batches and
+// drives the Cache. Loaded values are cross-checked against the
+// values the workload observed so the functional results and the
+// simulated cache can never silently diverge.
+class Pipeline {
+private:
+	static size_t constexpr RING_SIZE = 1 << 16;
+	static size_t constexpr BATCH_SIZE = 256;
+
+	Cache& cache_;
+	const AddressLayout& layout_;
+	SPSCRing<AccessRecord> ring_;
+	std::vector<AccessRecord> staged_;
+	size_t nStaged_;
+	unsigned long long produced_;
+	std::atomic<unsigned long long> consumed_;
+	std::atomic<bool> done_;
+	// only touched by the consumer; published through consumed_
+	unsigned long long mismatches_;
+	std::thread consumer_;
+
+	void Consume() {
+		std::vector<AccessRecord> batch(BATCH_SIZE);
+		for (;;) {
+			size_t n = this->ring_.PopBatch(batch.data(), BATCH_SIZE);
+			if (n==0) {
+				if (this->done_.load(std::memory_order_acquire) && this->ring_.Empty()) {
+					return;
+				}
+				std::this_thread::yield();
+				continue;
+			}
+			for (size_t i=0; i<n; ++i) {
+				const AccessRecord& r = batch[i];
+				const Address address(r.address_, this->layout_);
+				double value;
+				// same-block runs stay on the filter and skip dispatch
+				if (r.write_) {
+					if (!this->cache_.RecentSet(address, r.value_)) {
+						this->cache_.SetDouble(address, r.value_);
+					}
+					continue;
+				}
+				if (!this->cache_.RecentGet(address, value)) {
+					value = this->cache_.GetDouble(address);
+				}
+				if (value!=r.value_) ++this->mismatches_;
+			}
+			this->consumed_.fetch_add(n, std::memory_order_release);
+		}
+	}
+
+public:
+	Pipeline(Cache& cache, const AddressLayout& layout) : cache_(cache),
+		layout_(layout), ring_(RING_SIZE),
+		staged_(BATCH_SIZE), nStaged_(0), produced_(0), consumed_(0),
+		done_(false), mismatches_(0) {
+		this->consumer_ = std::thread(&Pipeline::Consume, this);
+	}
+
+	~Pipeline() {
+		this->Flush();
+		this->done_.store(true, std::memory_order_release);
+		this->consumer_.join();
+	}
+
+	void Submit(const uint32_t address, const bool write, const double value) {
+		AccessRecord& r = this->staged_[this->nStaged_++];
+		r.address_ = address;
+		r.write_ = write;
+		r.value_ = value;
+		if (this->nStaged_==BATCH_SIZE) this->Flush();
+	}
+
+	void Flush() {
+		size_t pushed = 0;
+		while (pushed < this->nStaged_) {
+			size_t n = this->ring_.PushBatch(this->staged_.data() + pushed,
+					this->nStaged_ - pushed);
+			if (n==0) std::this_thread::yield();
+			pushed += n;
+		}
+		this->produced_ += this->nStaged_;
+		this->nStaged_ = 0;
+	}
+
+	// blocks until the consumer has applied every submitted access
+	void Drain() {
+		this->Flush();
+		while (this->consumed_.load(std::memory_order_acquire)!=this->produced_) {
+			std::this_thread::yield();
+		}
+	}
+
+	unsigned long long GetMismatches() const { return this->mismatches_; }
+};
+
+
 class CPU {
 private:
 	std::unique_ptr<RAM> ram_;
 	std::unique_ptr<Cache> cache_;
 	const CacheConfig& config_;
+	// functional memory image the producer reads from in pipelined mode
+	std::vector<double> memory_;
+	// declared after cache_ so the consumer thread is joined first
+	std::unique_ptr<Pipeline> pipeline_;
+	std::unique_ptr<Sampler> sampler_;
+	std::unique_ptr< MRCProfiler<IndexFunction> > profiler_;
+	std::unique_ptr<TLB> tlb_;
+	std::unique_ptr<TimingModel> timing_;
+	std::unique_ptr<IntervalWriter> stats_;
+	std::unique_ptr<SteadyState> steady_;
+	unsigned long long accesses_;
+	// access count of the next interval snapshot, 0 when disabled
+	unsigned long long nextSnapshot_;
+	// outer iterations still being fast-forwarded, the last of
+	// which re-warm the cache, the counters once they are done,
+	// and whether the one fast-forward of the run has happened
+	static uint32_t constexpr WARM_TURNOVER = 2;
+	unsigned long long skipLeft_;
+	unsigned long long warmLeft_;
+	std::vector<unsigned long long> target_;
+	bool forwarded_;
+	// access count of a restored checkpoint; the accesses before it
+	// are replayed against RAM only, so the run continues the one
+	// the checkpoint was taken from
+	unsigned long long replayTo_;
 
 public:
-	CPU(const CacheConfig& config) : config_(config) {
-		DataBlock::StaticInit(config);
-		Address::StaticInit(config);
+	CPU(const CacheConfig& config) : config_(config), accesses_(0), nextSnapshot_(0),
+		skipLeft_(0), warmLeft_(0), forwarded_(false), replayTo_(0) {
 		this->ram_ = std::unique_ptr<RAM>{ new RAM(config) };
 		this->cache_ = Cache::Create(config, *this->ram_);
+		if (!config.restorePath.empty()) {
+			this->replayTo_ = this->cache_->LoadCheckpoint(config.restorePath.c_str());
+			if (config.resetStats) this->cache_->ResetStats();
+		}
+		if (config.pipelined) {
+			this->memory_.resize(config.totalWords);
+			this->pipeline_ = std::unique_ptr<Pipeline>{ new Pipeline(*this->cache_, this->ram_->GetLayout()) };
+		}
+		if (config.Sampling()) {
+			this->sampler_ = std::unique_ptr<Sampler>{ new Sampler(config.numSets,
+				config.sampleSetRatio, config.samplePeriod,
+				config.sampleWarmup, config.sampleDetail) };
+		}
+		if (config.Profiling()) {
+			// sizes from a sixteenth to eight times the configured
+			// cache, each with the set count and index function the
+			// real cache of that size would have
+			std::vector< std::pair<uint32_t, uint32_t> > sizes;
+			std::vector<IndexFunction> indices;
+			const uint32_t minSize = config.blockSize * config.nWay;
+			uint32_t size = config.cacheSize / 16 < minSize ? minSize : config.cacheSize / 16;
+			for (; size <= config.cacheSize * 8ull; size *= 2) {
+				CacheConfig c = config;
+				c.cacheSize = size;
+				c.ComputeStats();
+				sizes.push_back(std::make_pair(size, c.numSets));
+				indices.push_back(IndexFunction(c.numSets, c.index==CacheConfig::XorFold));
+			}
+			this->profiler_ = std::unique_ptr< MRCProfiler<IndexFunction> >{
+				new MRCProfiler<IndexFunction>(sizes, indices, config.nWay,
+					config.mrcRate, config.mrcMaxSamples) };
+		}
+		if (config.tlb) {
+			// TagCache::Policy mirrors CacheConfig::Policy
+			this->tlb_ = std::unique_ptr<TLB>{ new TLB(config.pageSize,
+				config.dtlbEntries, config.dtlbWays, config.stlbEntries,
+				config.stlbWays, static_cast<TagCache::Policy>(config.tlbPolicy),
+				config.pageTableBase, config.dataSize) };
+		}
+		if (config.timing) {
+			this->timing_ = std::unique_ptr<TimingModel>{ new TimingModel(
+				config.hitLatency, config.missLatency, config.bufferLatency,
+				config.mshrs, config.window) };
+			if (config.dram) {
+				this->timing_->AttachDRAM(std::unique_ptr<DRAM>{ new DRAM(
+					config.dramChannels, config.dramRanks, config.dramBanks,
+					config.dramRowSize, config.blockSize, config.dramOpenPage,
+					config.dramMapping, config.dramTiming) });
+			}
+		}
+		if (config.statsInterval) {
+			this->stats_ = std::unique_ptr<IntervalWriter>{
+				new IntervalWriter(config.statsPath, config.statsJson) };
+			this->nextSnapshot_ = this->replayTo_ + config.statsInterval;
+		}
+		if (config.fastForward) {
+			this->steady_ = std::unique_ptr<SteadyState>{ new SteadyState() };
+		}
 	}
 
 	double LoadDouble(const Address& address) {
@@ -743,7 +2181,31 @@ public:
 				" word: " << address.GetWord() <<
 				" ram block: " << address.GetRamBlock() << std::endl;
 #endif
-		return this->cache_->GetDouble(address);
+		if (this->pipeline_) {
+			const double value = this->memory_[address.address_/this->config_.wordSize];
+			this->pipeline_->Submit(address.address_, false, value);
+			return value;
+		}
+		if (this->sampler_) {
+			// RAM is authoritative under write-through, and lines
+			// left over from a skipped interval may be stale
+			this->Sampled(address, false);
+			return this->ram_->GetWord(address);
+		}
+		if (this->profiler_) {
+			// the miniature caches replace the full one entirely
+			this->profiler_->Access(address.GetRamBlock());
+			return this->ram_->GetWord(address);
+		}
+		if (this->Functional()) {
+			return this->ram_->GetWord(address);
+		}
+		const bool walked = this->Translate(address);
+		const unsigned long long misses = this->cache_->GetMisses();
+		const unsigned long long buffered = this->cache_->GetBufferHits();
+		const double value = this->cache_->GetDouble(address);
+		this->Retire(address, false, this->SourceSince(misses, buffered), walked);
+		return value;
 	}
 
 	void StoreDouble(Address& address, double value) {
@@ -756,7 +2218,231 @@ public:
 			" word: " << address.GetWord() <<
 			" ram block: " << address.GetRamBlock() << std::endl;
 #endif
+		if (this->pipeline_) {
+			this->memory_[address.address_/this->config_.wordSize] = value;
+			this->pipeline_->Submit(address.address_, true, value);
+			return;
+		}
+		if (this->sampler_) {
+			if (!this->Sampled(address, true, value)) {
+				this->ram_->SetWord(address, address.GetWord(), value);
+			}
+			return;
+		}
+		if (this->profiler_) {
+			this->profiler_->Access(address.GetRamBlock());
+			this->ram_->SetWord(address, address.GetWord(), value);
+			return;
+		}
+		if (this->Functional()) {
+			this->ram_->SetWord(address, address.GetWord(), value);
+			return;
+		}
+		const bool walked = this->Translate(address);
+		const unsigned long long misses = this->cache_->GetMisses();
+		const unsigned long long buffered = this->cache_->GetBufferHits();
 		this->cache_->SetDouble(address, value);
+		this->Retire(address, true, this->SourceSince(misses, buffered), walked);
+	}
+
+private:
+	// true when an access only runs against RAM: it is fast-forwarded
+	// and counted by extrapolation, or it is replayed up to a restored
+	// checkpoint, whose counters already include it. the restored
+	// lines are reloaded once RAM has caught up.
+	bool Functional() {
+		if (this->skipLeft_ > this->warmLeft_) return true;
+		if (this->accesses_ >= this->replayTo_) return false;
+		if (++this->accesses_==this->replayTo_) this->cache_->Resync();
+		return true;
+	}
+
+	// where the one cache access since the counters were read found
+	// its block
+	TimingModel::Source SourceSince(const unsigned long long misses,
+			const unsigned long long buffered) const {
+		if (this->cache_->GetMisses()==misses) return TimingModel::Hit;
+		if (this->cache_->GetBufferHits()!=buffered) return TimingModel::Buffer;
+		return TimingModel::Memory;
+	}
+
+	// looks the page up in the TLB and, on a walk, optionally
+	// reads the page table entries through the data cache, each
+	// level waiting on the one before. returns whether the access
+	// has to wait on such a walk.
+	bool Translate(const Address& address) {
+		if (!this->tlb_ || !this->tlb_->Translate(address.address_)) return false;
+		if (!this->config_.pageWalk) return false;
+		for (uint32_t level=0; level<this->tlb_->GetWalkLevels(); ++level) {
+			const Address entry(this->tlb_->WalkAddress(address.address_, level),
+					this->ram_->GetLayout());
+			const unsigned long long misses = this->cache_->GetMisses();
+			const unsigned long long buffered = this->cache_->GetBufferHits();
+			this->cache_->GetDouble(entry);
+			this->tlb_->RecordWalk(this->cache_->GetMisses()!=misses);
+			if (this->timing_) {
+				this->timing_->Access(entry.GetRamBlock(), false,
+						this->SourceSince(misses, buffered), level!=0);
+			}
+		}
+		return true;
+	}
+
+	// times a directly simulated access, counts it and takes the
+	// checkpoint once the requested access count is reached
+	void Retire(const Address& address, const bool write,
+			const TimingModel::Source source, const bool walked) {
+		if (this->timing_) {
+			this->timing_->Access(address.GetRamBlock(), write, source, walked);
+		}
+		this->Count();
+	}
+
+	// counts one more access, taking the interval snapshot and the
+	// checkpoint due at it
+	void Count() {
+		if (++this->accesses_==this->nextSnapshot_) {
+			this->stats_->Push(this->Capture());
+			this->nextSnapshot_ += this->config_.statsInterval;
+		}
+		if (this->accesses_!=this->config_.checkpointAt) return;
+		this->cache_->SaveCheckpoint(this->config_.checkpointPath.c_str(), this->accesses_);
+		if (this->config_.resetStats) this->cache_->ResetStats();
+	}
+
+	Snapshot Capture() const {
+		Snapshot s;
+		memset(&s, 0, sizeof(s));
+		s.accesses_ = this->accesses_;
+		s.rhits_ = this->cache_->GetReadHits();
+		s.rmisses_ = this->cache_->GetReadMisses();
+		s.whits_ = this->cache_->GetWriteHits();
+		s.wmisses_ = this->cache_->GetWriteMisses();
+		s.evictions_ = this->cache_->GetEvictions();
+		s.occupancy_ = this->cache_->GetOccupancy();
+		s.bufferHits_ = this->cache_->GetBufferHits();
+		if (this->tlb_) {
+			s.dtlbMisses_ = this->tlb_->GetL1Misses();
+			s.stlbMisses_ = this->tlb_->GetL2Misses();
+		}
+		if (this->timing_) s.cycles_ = this->timing_->GetCycles();
+		return s;
+	}
+
+	// routes one access through the sampler; returns false when
+	// it was filtered out and never reached the cache
+	bool Sampled(const Address& address, const bool write, const double value = 0) {
+		const Sampler::Verdict v = this->sampler_->Classify(
+				this->cache_->SetOf(address.GetRamBlock()));
+		if (v==Sampler::Skip) return false;
+		const unsigned long long misses = this->cache_->GetMisses();
+		if (write) {
+			this->cache_->SetDouble(address, value);
+		} else {
+			this->cache_->GetDouble(address);
+		}
+		if (v==Sampler::Detail) {
+			this->sampler_->Record(write, this->cache_->GetMisses()!=misses);
+		}
+		return true;
+	}
+
+public:
+	const AddressLayout& GetLayout() const {
+		return this->ram_->GetLayout();
+	}
+
+	const Cache& GetCache() const {
+		return *this->cache_;
+	}
+
+	// n further reads or writes to address, whose values the caller
+	// does not need (stores write zero). while its block sits in the
+	// same-block filter and no per-access model is on, they are
+	// counted as filter hits in runs cut at the next interval
+	// snapshot or checkpoint, so those still fall on their exact
+	// access; otherwise they are simulated one by one.
+	void RepeatLast(const Address& address, uint32_t n, const bool write) {
+		const bool direct = !this->pipeline_ && !this->sampler_ && !this->profiler_ &&
+			!this->tlb_ && !this->timing_;
+		while (n) {
+			if (!direct || this->accesses_ < this->replayTo_ || this->skipLeft_ ||
+					!this->cache_->InRecent(address.GetRamBlock())) {
+				if (write) {
+					Address a = address;
+					this->StoreDouble(a, 0.);
+				} else {
+					this->LoadDouble(address);
+				}
+				--n;
+				continue;
+			}
+			unsigned long long run = n;
+			if (this->stats_) run = std::min(run, this->nextSnapshot_ - this->accesses_);
+			if (this->config_.checkpointAt > this->accesses_) {
+				run = std::min(run, this->config_.checkpointAt - this->accesses_);
+			}
+			this->cache_->RecentRun(write ? 0 : run, write ? run : 0);
+			this->accesses_ += run - 1;
+			this->Count();
+			n -= run;
+		}
+	}
+
+	// called by the kernels at the start of every outer iteration
+	// with the number of iterations left, this one included, and
+	// the first element of each array the iteration works on. once
+	// the steady-state detector reports a period and the cache state
+	// relative to those elements recurs over it, whole periods of
+	// the remaining iterations run functionally against RAM while
+	// their counters are extrapolated from the last period. the
+	// lines are then reloaded and the last stretch of the skipped
+	// iterations is simulated again to bring the replacement state
+	// up to date before the counters are set to the extrapolated
+	// totals; the tail (and any verification) is exact.
+	void OuterIteration(const unsigned long long remaining, const Address& a,
+			const Address& b, const Address& c) {
+		if (!this->steady_) return;
+		if (this->skipLeft_) {
+			--this->skipLeft_;
+			if (this->skipLeft_==this->warmLeft_) this->cache_->Resync();
+			if (this->skipLeft_==0) {
+				this->cache_->SetCounters(this->target_);
+				this->accesses_ = this->target_.back();
+			}
+			return;
+		}
+		if (this->forwarded_) return;
+		std::vector<unsigned long long> counters = this->cache_->GetCounters();
+		counters.push_back(this->accesses_);
+		const uint32_t period = this->steady_->Boundary(counters);
+		if (period==0 || remaining < 2 * period) return;
+		const uint32_t bases[MATS] = { a.GetRamBlock(), b.GetRamBlock(), c.GetRamBlock() };
+		const Cache& cache = *this->cache_;
+		if (!this->steady_->Recurs(period, [&cache, &bases]() {
+					return cache.Fingerprint(bases);
+				})) {
+			return;
+		}
+		// warm up with enough misses to turn the whole cache over,
+		// and leave at least one period as the exact tail
+		const std::vector<unsigned long long> delta = this->steady_->PeriodDelta(period);
+		const unsigned long long misses = Cache::MissesIn(delta);
+		const unsigned long long lines = WARM_TURNOVER * this->config_.cacheBlockCount;
+		const unsigned long long warm = misses ? (lines + misses - 1) / misses : 1;
+		const unsigned long long periods = remaining / period - 1;
+		if (periods <= warm) return;
+		this->target_ = counters;
+		for (size_t i=0; i<counters.size(); ++i) this->target_[i] += delta[i] * periods;
+		this->skipLeft_ = periods * period;
+		this->warmLeft_ = warm * period;
+		this->forwarded_ = true;
+		this->steady_->RecordSkip(period, this->skipLeft_ - this->warmLeft_);
+	}
+
+	// simulated cycles so far, 0 without a timing model
+	unsigned long long GetCycles() const {
+		return this->timing_ ? this->timing_->GetCycles() : 0;
 	}
 
 	double AddDouble(double val1, double val2) const {
@@ -768,7 +2454,46 @@ public:
 	}
 
 	void PrintStats() const {
+		if (this->pipeline_) {
+			this->pipeline_->Drain();
+		}
 		this->config_.PrintStats();
+		if (this->profiler_) {
+			this->profiler_->PrintStats();
+			return;
+		}
 		this->cache_->PrintStats();
+		if (this->tlb_) {
+			this->tlb_->PrintStats();
+		}
+		if (this->timing_) {
+			this->timing_->Finish();
+			this->timing_->PrintStats();
+		}
+		if (this->stats_) {
+			// the last, possibly partial, interval
+			if (this->accesses_ + this->config_.statsInterval!=this->nextSnapshot_) {
+				this->stats_->Push(this->Capture());
+			}
+			this->stats_->Finish();
+			this->stats_->PrintStats();
+		}
+		if (this->sampler_) {
+			this->sampler_->PrintStats();
+		}
+		if (this->steady_) {
+			this->steady_->PrintStats();
+		}
+		if (this->pipeline_) {
+			std::cout << "Pipeline value mismatches: " <<
+				this->pipeline_->GetMismatches() << std::endl;
+			if (this->config_.runTests && this->pipeline_->GetMismatches()!=0) {
+				std::cerr << "Pipelined cache values diverged " \
+						"from the workload. Aborting.\n";
+				exit(1);
+			}
+		}
 	}
 };
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef DRAM_HPP
+#define DRAM_HPP
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+// DRAM behind RAM: channels of ranks of banks, each bank with one
+// row buffer kept open (open page) or precharged right after every
+// access (closed page). Block numbers are mapped to channel, rank,
+// bank, row and column either row-interleaved (consecutive blocks
+// share a row) or line-interleaved (consecutive blocks rotate across
+// channels and banks). Reads (fills) and the write-through stream share
+// one request queue per channel, scheduled FR-FCFS: of the eligible
+// requests that can start earliest, row hits go before misses and older
+// before younger. Reads have priority, so a queued write is eligible
+// only while no read is waiting (it can start before the next read
+// arrives) or while the channel drains, which starts once WRITE_HIGH
+// writes are queued and stops at WRITE_LOW. A read is scheduled as soon
+// as it arrives, because the timing model needs the cycle its fill
+// completes; reads therefore never reorder among themselves, only
+// around writes. Writes occupy banks and the data bus, which is how
+// they delay later reads. Times are in CPU cycles.
+class DRAM {
+public:
+	enum Mapping { RowInterleaved, LineInterleaved };
+
+	struct Timing {
+		uint32_t tRCD_;
+		uint32_t tCAS_;
+		uint32_t tRP_;
+		uint32_t tBURST_;
+	};
+
+private:
+	static uint32_t constexpr WRITE_HIGH = 32;
+	static uint32_t constexpr WRITE_LOW = 16;
+	static uint32_t constexpr NO_ROW = 0xFFFFFFFFu;
+
+	struct Request {
+		uint32_t bank_;
+		uint32_t row_;
+		unsigned long long arrival_;
+		bool write_;
+	};
+
+	struct Bank {
+		uint32_t openRow_;
+		unsigned long long ready_;
+	};
+
+	struct Channel {
+		std::vector<Bank> banks_;
+		// pending requests, oldest first
+		std::vector<Request> queue_;
+		size_t queuedWrites_;
+		bool draining_;
+		unsigned long long busReady_;
+	};
+
+	const uint32_t channels_;
+	const uint32_t ranks_;
+	const uint32_t banks_;
+	const uint32_t columns_;
+	const bool openPage_;
+	const Mapping mapping_;
+	const Timing timing_;
+	std::vector<Channel> state_;
+	unsigned long long reads_;
+	unsigned long long writes_;
+	unsigned long long rowHits_;
+	unsigned long long rowEmpty_;
+	unsigned long long rowConflicts_;
+	unsigned long long readLatency_;
+	unsigned long long queueDelay_;
+
+	void Map(const uint32_t block, uint32_t& channel, uint32_t& bank, uint32_t& row) const {
+		uint32_t rest = block;
+		if (this->mapping_==RowInterleaved) {
+			rest /= this->columns_;
+			channel = rest % this->channels_;
+			rest /= this->channels_;
+			bank = rest % (this->banks_ * this->ranks_);
+			row = rest / (this->banks_ * this->ranks_);
+		} else {
+			channel = rest % this->channels_;
+			rest /= this->channels_;
+			bank = rest % (this->banks_ * this->ranks_);
+			rest /= this->banks_ * this->ranks_;
+			row = rest / this->columns_;
+		}
+	}
+
+	// services one request starting no earlier than now and
+	// returns the cycle its burst completes
+	unsigned long long Issue(Channel& ch, const Request& r, const unsigned long long now) {
+		Bank& bank = ch.banks_[r.bank_];
+		const unsigned long long start = now > bank.ready_ ? now : bank.ready_;
+		unsigned long long latency = this->timing_.tCAS_;
+		if (bank.openRow_==r.row_) {
+			++this->rowHits_;
+		} else if (bank.openRow_==NO_ROW) {
+			++this->rowEmpty_;
+			latency += this->timing_.tRCD_;
+		} else {
+			++this->rowConflicts_;
+			latency += this->timing_.tRP_ + this->timing_.tRCD_;
+		}
+		unsigned long long burst = start + latency;
+		if (burst < ch.busReady_) burst = ch.busReady_;
+		const unsigned long long done = burst + this->timing_.tBURST_;
+		ch.busReady_ = done;
+		if (this->openPage_) {
+			bank.openRow_ = r.row_;
+			bank.ready_ = done;
+		} else {
+			bank.openRow_ = NO_ROW;
+			bank.ready_ = done + this->timing_.tRP_;
+		}
+		this->queueDelay_ += start - r.arrival_;
+		return done;
+	}
+
+	// FR-FCFS over the queue until nothing is eligible or, when read
+	// is set, until the read at its back has been issued, returning the
+	// cycle its burst completes. A drain stops once only low writes
+	// remain.
+	unsigned long long Schedule(Channel& ch, const bool read, const size_t low) {
+		const unsigned long long arrival = read ? ch.queue_.back().arrival_ : 0;
+		while (!ch.queue_.empty()) {
+			if (ch.queuedWrites_ <= low) ch.draining_ = false;
+			size_t best = 0;
+			unsigned long long bestStart = 0;
+			bool bestHit = false;
+			bool found = false;
+			for (size_t i=0; i<ch.queue_.size(); ++i) {
+				const Request& r = ch.queue_[i];
+				const Bank& bank = ch.banks_[r.bank_];
+				const unsigned long long start = r.arrival_ > bank.ready_ ? r.arrival_ : bank.ready_;
+				const bool eligible = r.write_ ? ch.draining_ || (read && start < arrival) :
+						!ch.draining_;
+				if (!eligible) continue;
+				const bool hit = bank.openRow_==r.row_;
+				if (!found || start < bestStart || (start==bestStart && hit && !bestHit)) {
+					best = i;
+					bestStart = start;
+					bestHit = hit;
+					found = true;
+				}
+			}
+			if (!found) break;
+			const Request r = ch.queue_[best];
+			ch.queue_.erase(ch.queue_.begin() + best);
+			const unsigned long long done = this->Issue(ch, r, bestStart);
+			if (!r.write_) return done;
+			--ch.queuedWrites_;
+		}
+		return 0;
+	}
+
+public:
+	DRAM(uint32_t channels, uint32_t ranks, uint32_t banks, uint32_t rowSize,
+		uint32_t blockSize, bool openPage, Mapping mapping, Timing timing) :
+		channels_(channels ? channels : 1), ranks_(ranks ? ranks : 1),
+		banks_(banks ? banks : 1),
+		columns_(rowSize / blockSize ? rowSize / blockSize : 1),
+		openPage_(openPage), mapping_(mapping), timing_(timing),
+		state_(channels_), reads_(0), writes_(0), rowHits_(0), rowEmpty_(0),
+		rowConflicts_(0), readLatency_(0), queueDelay_(0) {
+		for (Channel& ch : this->state_) {
+			Bank closed = { NO_ROW, 0 };
+			ch.banks_.assign(this->ranks_ * this->banks_, closed);
+			ch.busReady_ = 0;
+			ch.queuedWrites_ = 0;
+			ch.draining_ = false;
+		}
+	}
+
+	// returns the cycle the block's data is back
+	unsigned long long Read(const uint32_t block, const unsigned long long now) {
+		++this->reads_;
+		Request r;
+		uint32_t channel;
+		this->Map(block, channel, r.bank_, r.row_);
+		r.arrival_ = now;
+		r.write_ = false;
+		Channel& ch = this->state_[channel];
+		ch.queue_.push_back(r);
+		const unsigned long long done = this->Schedule(ch, true, WRITE_LOW);
+		this->readLatency_ += done - now;
+		return done;
+	}
+
+	void Write(const uint32_t block, const unsigned long long now) {
+		++this->writes_;
+		Request r;
+		uint32_t channel;
+		this->Map(block, channel, r.bank_, r.row_);
+		r.arrival_ = now;
+		r.write_ = true;
+		Channel& ch = this->state_[channel];
+		ch.queue_.push_back(r);
+		if (++ch.queuedWrites_ >= WRITE_HIGH) {
+			ch.draining_ = true;
+			this->Schedule(ch, false, WRITE_LOW);
+		}
+	}
+
+	// services every queued write, for end-of-run accounting
+	void Flush() {
+		for (Channel& ch : this->state_) {
+			ch.draining_ = true;
+			this->Schedule(ch, false, 0);
+		}
+	}
+
+	void PrintStats() const {
+		const unsigned long long accesses = this->rowHits_ + this->rowEmpty_ + this->rowConflicts_;
+		std::cout << "DRAM" << std::string(28, '=') << std::endl;
+		std::cout << "Channels: " << this->channels_ << " Ranks: " << this->ranks_ <<
+			" Banks: " << this->banks_ << std::endl;
+		std::cout << "Page Policy: " << (this->openPage_ ? "open" : "closed") << std::endl;
+		std::cout << "Address Mapping: " << (this->mapping_==RowInterleaved ?
+			"row" : "line") << std::endl;
+		std::cout << "DRAM reads: " << this->reads_ << std::endl;
+		std::cout << "DRAM writes: " << this->writes_ << std::endl;
+		std::cout << "Row buffer hits: " << this->rowHits_ << std::endl;
+		std::cout << "Row buffer hit rate: " <<
+			(accesses ? static_cast<double>(this->rowHits_) / accesses : 0) << std::endl;
+		std::cout << "Bank conflicts: " << this->rowConflicts_ << std::endl;
+		std::cout << "Average read latency: " <<
+			(this->reads_ ? static_cast<double>(this->readLatency_) / this->reads_ : 0) << std::endl;
+		std::cout << "Average queueing delay: " <<
+			(accesses ? static_cast<double>(this->queueDelay_) / accesses : 0) << std::endl;
+	}
+};
+
+#endif
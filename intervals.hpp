@@ -0,0 +1,138 @@
+#ifndef INTERVALS_HPP
+#define INTERVALS_HPP
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+#include "ringbuffer.hpp"
+
+// Cumulative counters at one point of the run. Levels that are not
+// simulated stay zero.
+struct Snapshot {
+	unsigned long long accesses_;
+	unsigned long long rhits_;
+	unsigned long long rmisses_;
+	unsigned long long whits_;
+	unsigned long long wmisses_;
+	unsigned long long evictions_;
+	unsigned long long bufferHits_;
+	unsigned long long dtlbMisses_;
+	unsigned long long stlbMisses_;
+	unsigned long long cycles_;
+	unsigned long long occupancy_;
+};
+
+// Time series of interval statistics. The simulator pushes a Snapshot
+// every `interval` accesses into a preallocated ring and a background
+// thread turns consecutive snapshots into one row per interval of CSV
+// or JSON, so the hot path only copies counters and never formats or
+// waits on I/O. If the writer falls behind and the ring is full the
+// snapshot is dropped and counted instead of stalling the simulation.
+// Rows hold per-interval deltas except for the access count and the
+// occupancy, which are absolute.
+class IntervalWriter {
+private:
+	static size_t constexpr RING_SIZE = 1 << 12;
+	static size_t constexpr BATCH_SIZE = 64;
+
+	const std::string path_;
+	const bool json_;
+	FILE * out_;
+	SPSCRing<Snapshot> ring_;
+	std::atomic<bool> done_;
+	// producer side
+	unsigned long long dropped_;
+	// writer side, read after the join
+	unsigned long long rows_;
+	Snapshot last_;
+	std::thread writer_;
+
+	// a statistics reset makes a counter go backwards; the interval
+	// then covers only what happened since the reset
+	static unsigned long long Delta(const unsigned long long now, const unsigned long long then) {
+		return now >= then ? now - then : now;
+	}
+
+	void Row(const Snapshot& s) {
+		const Snapshot& p = this->last_;
+		const unsigned long long v[] = { s.accesses_,
+			Delta(s.rhits_, p.rhits_), Delta(s.rmisses_, p.rmisses_),
+			Delta(s.whits_, p.whits_), Delta(s.wmisses_, p.wmisses_),
+			Delta(s.evictions_, p.evictions_), s.occupancy_,
+			Delta(s.bufferHits_, p.bufferHits_), Delta(s.dtlbMisses_, p.dtlbMisses_),
+			Delta(s.stlbMisses_, p.stlbMisses_), Delta(s.cycles_, p.cycles_) };
+		if (this->json_) {
+			fprintf(this->out_, "%s{\"accesses\": %llu, \"read_hits\": %llu, "
+				"\"read_misses\": %llu, \"write_hits\": %llu, \"write_misses\": %llu, "
+				"\"evictions\": %llu, \"occupancy\": %llu, \"buffer_hits\": %llu, "
+				"\"dtlb_misses\": %llu, \"stlb_misses\": %llu, \"cycles\": %llu}",
+				this->rows_ ? ",\n" : "\n", v[0], v[1], v[2], v[3], v[4], v[5],
+				v[6], v[7], v[8], v[9], v[10]);
+		} else {
+			fprintf(this->out_, "%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+				v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10]);
+		}
+		this->last_ = s;
+		++this->rows_;
+	}
+
+	void Write() {
+		Snapshot batch[BATCH_SIZE];
+		if (this->json_) {
+			fputc('[', this->out_);
+		} else {
+			fputs("accesses,read_hits,read_misses,write_hits,write_misses,evictions,"
+				"occupancy,buffer_hits,dtlb_misses,stlb_misses,cycles\n", this->out_);
+		}
+		for (;;) {
+			const size_t n = this->ring_.PopBatch(batch, BATCH_SIZE);
+			if (n==0) {
+				if (this->done_.load(std::memory_order_acquire) && this->ring_.Empty()) break;
+				// rows are rare next to accesses; idle without spinning
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+			for (size_t i=0; i<n; ++i) this->Row(batch[i]);
+		}
+		if (this->json_) fputs("\n]\n", this->out_);
+	}
+
+public:
+	IntervalWriter(const std::string& path, const bool json) :
+		path_(path), json_(json), out_(fopen(path.c_str(), "w")),
+		ring_(RING_SIZE), done_(false), dropped_(0), rows_(0), last_() {
+		if (!this->out_) throw std::runtime_error("cannot write interval stats to " + path);
+		this->writer_ = std::thread(&IntervalWriter::Write, this);
+	}
+
+	~IntervalWriter() {
+		this->Finish();
+	}
+
+	void Push(const Snapshot& s) {
+		if (this->writer_.joinable() && !this->ring_.Push(s)) ++this->dropped_;
+	}
+
+	// writes out everything pushed so far and closes the file;
+	// later snapshots are ignored
+	void Finish() {
+		if (!this->writer_.joinable()) return;
+		this->done_.store(true, std::memory_order_release);
+		this->writer_.join();
+		fclose(this->out_);
+	}
+
+	void PrintStats() const {
+		std::cout << "Stats intervals written: " << this->rows_ << " to " <<
+			this->path_ << std::endl;
+		if (this->dropped_) {
+			std::cout << "Stats intervals dropped: " << this->dropped_ << std::endl;
+		}
+	}
+};
+
+#endif
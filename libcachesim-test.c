@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "libcachesim.h"
+
+/* Two instances with different block sizes stream over the same
+ * array in one process. Every block is touched once, so each reports
+ * exactly one miss per block and the rest as hits. A tag-only
+ * instance then streams over the same array placed high in a 64-bit
+ * address space, and replays a conflicting trace that must give the
+ * counts of the full simulator. */
+
+#define WORDS 4096
+#define HIGH 0x7ffd12340000ull
+
+static int check(const char * what, unsigned long long got, unsigned long long want) {
+	if (got==want) return 0;
+	fprintf(stderr, "%s: got %llu, want %llu\n", what, got, want);
+	return 1;
+}
+
+int main(void) {
+	cachesim_config config;
+	cachesim_access batch[WORDS];
+	cachesim_access bad = { 1u << 30, 0 };
+	cachesim_counters small, large, tagged;
+	cachesim * a;
+	cachesim * b;
+	cachesim * t;
+	int fail = 0;
+	unsigned i;
+
+	cachesim_config_init(&config);
+	config.cache_size = 4096;
+	config.block_size = 32;
+	config.associativity = 4;
+	config.memory_size = WORDS * 8;
+	a = cachesim_create(&config);
+	config.block_size = 64;
+	config.policy = CACHESIM_RANDOM;
+	config.timing = 1;
+	b = cachesim_create(&config);
+	if (!a || !b) {
+		fprintf(stderr, "cachesim_create failed\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i=0; i<WORDS; ++i) {
+		batch[i].address = i * 8;
+		batch[i].write = 0;
+	}
+	fail |= cachesim_access_batch(a, batch, WORDS)!=CACHESIM_OK;
+	fail |= cachesim_access_batch(b, batch, WORDS)!=CACHESIM_OK;
+	fail |= cachesim_access_batch(a, &bad, 1)!=CACHESIM_ERANGE;
+
+	cachesim_get_counters(a, &small);
+	cachesim_get_counters(b, &large);
+	fail |= check("32B read misses", small.read_misses, WORDS / 4);
+	fail |= check("32B read hits", small.read_hits, WORDS - WORDS / 4);
+	fail |= check("64B read misses", large.read_misses, WORDS / 8);
+	fail |= check("64B read hits", large.read_hits, WORDS - WORDS / 8);
+	fail |= small.cycles!=0 || large.cycles==0;
+
+	config.associativity = 0;
+	fail |= cachesim_create(&config)!=NULL;
+	/* the timing model needs the full simulator */
+	config.associativity = 4;
+	config.memory_size = 0;
+	fail |= cachesim_create(&config)!=NULL;
+
+	config.block_size = 32;
+	config.policy = CACHESIM_LRU;
+	config.timing = 0;
+	t = cachesim_create(&config);
+	if (!t) {
+		fprintf(stderr, "tag-only cachesim_create failed\n");
+		return EXIT_FAILURE;
+	}
+	for (i=0; i<WORDS; ++i) batch[i].address = HIGH + i * 8;
+	fail |= cachesim_access_batch(t, batch, WORDS)!=CACHESIM_OK;
+	cachesim_get_counters(t, &tagged);
+	fail |= check("tag-only read misses", tagged.read_misses, WORDS / 4);
+	fail |= check("tag-only read hits", tagged.read_hits, WORDS - WORDS / 4);
+	cachesim_destroy(t);
+
+	/* strides that map onto few sets, mixed reads and writes */
+	config.memory_size = WORDS * 8;
+	cachesim_destroy(a);
+	a = cachesim_create(&config);
+	config.memory_size = 0;
+	t = cachesim_create(&config);
+	if (!a || !t) {
+		fprintf(stderr, "cachesim_create failed\n");
+		return EXIT_FAILURE;
+	}
+	for (i=0; i<WORDS; ++i) {
+		batch[i].address = (i * 1032u) % (WORDS * 8) & ~7u;
+		batch[i].write = i % 3==0;
+	}
+	fail |= cachesim_access_batch(a, batch, WORDS)!=CACHESIM_OK;
+	fail |= cachesim_access_batch(t, batch, WORDS)!=CACHESIM_OK;
+	cachesim_get_counters(a, &small);
+	cachesim_get_counters(t, &tagged);
+	fail |= check("tag-only read misses vs full", tagged.read_misses, small.read_misses);
+	fail |= check("tag-only write misses vs full", tagged.write_misses, small.write_misses);
+	fail |= check("tag-only hits vs full", tagged.read_hits + tagged.write_hits,
+			small.read_hits + small.write_hits);
+
+	cachesim_destroy(a);
+	cachesim_destroy(b);
+	cachesim_destroy(t);
+	if (fail) {
+		fprintf(stderr, "libcachesim test failed\n");
+		return EXIT_FAILURE;
+	}
+	printf("libcachesim test passed\n");
+	return EXIT_SUCCESS;
+}
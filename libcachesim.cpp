@@ -0,0 +1,218 @@
+#include "cache.hpp"
+#include "libcachesim.h"
+
+// Tag-only set-associative cache over 64-bit block numbers, for
+// instances without a memory image. It keeps the replacement state of
+// the full engines (set index function, LRU/FIFO/random, invalid ways
+// filled first) but no data, so any address of a 64-bit process can
+// be simulated directly. Ages are 64-bit and never wrap; 0 marks an
+// invalid way.
+class TagOnlyCache {
+private:
+	const uint32_t sets_;
+	const uint32_t ways_;
+	const CacheConfig::Policy policy_;
+	const CacheConfig::Index index_;
+	const uint32_t setBits_;
+	const uint32_t blockBits_;
+	std::vector<uint64_t> tags_;
+	std::vector<uint64_t> ages_;
+	uint64_t clock_;
+	uint32_t rng_;
+	unsigned long long rhits_;
+	unsigned long long rmisses_;
+	unsigned long long whits_;
+	unsigned long long wmisses_;
+
+	uint32_t NextRandom() {
+		uint32_t x = this->rng_;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return this->rng_ = x;
+	}
+
+	// IndexFunction widened to 64-bit blocks: XOR folding runs until
+	// the tag is exhausted, then the set count is taken modulo
+	size_t Base(const uint64_t block) const {
+		uint64_t index = block;
+		if (this->index_==CacheConfig::XorFold && this->setBits_) {
+			for (uint64_t tag = block >> this->setBits_; tag; tag >>= this->setBits_) {
+				index ^= tag;
+			}
+		}
+		return static_cast<size_t>(index % this->sets_) * this->ways_;
+	}
+
+public:
+	explicit TagOnlyCache(const CacheConfig& config) :
+		sets_(config.numSets), ways_(config.nWay), policy_(config.policy),
+		index_(config.index), setBits_(GetBitLength(config.numSets) - 1),
+		blockBits_(GetBitLength(config.blockSize) - 1),
+		tags_(static_cast<size_t>(sets_) * ways_, 0),
+		ages_(static_cast<size_t>(sets_) * ways_, 0), clock_(0),
+		rng_(static_cast<uint32_t>(time(NULL)) | 1),
+		rhits_(0), rmisses_(0), whits_(0), wmisses_(0) {}
+
+	void Access(const uint64_t address, const bool write) {
+		const uint64_t block = address >> this->blockBits_;
+		const size_t base = this->Base(block);
+		uint64_t * const tags = &this->tags_[base];
+		uint64_t * const ages = &this->ages_[base];
+		const uint64_t now = ++this->clock_;
+		uint32_t victim = 0;
+		for (uint32_t w=0; w<this->ways_; ++w) {
+			if (ages[w] && tags[w]==block) {
+				if (this->policy_==CacheConfig::LRU) ages[w] = now;
+				++(write ? this->whits_ : this->rhits_);
+				return;
+			}
+			if (ages[w] < ages[victim]) victim = w;
+		}
+		++(write ? this->wmisses_ : this->rmisses_);
+		if (ages[victim] && this->policy_==CacheConfig::Random) {
+			victim = this->NextRandom() % this->ways_;
+		}
+		tags[victim] = block;
+		ages[victim] = now;
+	}
+
+	unsigned long long GetReadHits() const { return this->rhits_; }
+	unsigned long long GetReadMisses() const { return this->rmisses_; }
+	unsigned long long GetWriteHits() const { return this->whits_; }
+	unsigned long long GetWriteMisses() const { return this->wmisses_; }
+};
+
+// An instance owns its configuration because CPU only keeps a
+// reference to it. Exactly one of cpu_ (memory_size set) and tags_
+// (tag-only) exists.
+struct cachesim {
+	CacheConfig config_;
+	std::unique_ptr<CPU> cpu_;
+	std::unique_ptr<TagOnlyCache> tags_;
+};
+
+extern "C" {
+
+void cachesim_config_init(cachesim_config * config) {
+	CacheConfig c;
+	config->cache_size = c.cacheSize;
+	config->block_size = c.blockSize;
+	config->associativity = c.nWay;
+	config->policy = CACHESIM_LRU;
+	config->index = CACHESIM_INDEX_MODULO;
+	config->memory_size = 0;
+	config->victim_entries = 0;
+	config->miss_cache = 0;
+	config->timing = 0;
+	config->mshrs = c.mshrs;
+	config->window = c.window;
+	config->hit_latency = c.hitLatency;
+	config->miss_latency = c.missLatency;
+}
+
+cachesim * cachesim_create(const cachesim_config * config) {
+	if (!config || config->policy > CACHESIM_RANDOM ||
+			config->index > CACHESIM_INDEX_SKEWED) {
+		return nullptr;
+	}
+	// the skewed organization, the buffers and the timing model live
+	// in the full engines only
+	if (config->memory_size==0 && (config->index==CACHESIM_INDEX_SKEWED ||
+			config->victim_entries || config->timing)) {
+		return nullptr;
+	}
+	try {
+		std::unique_ptr<cachesim> sim{ new cachesim };
+		CacheConfig& c = sim->config_;
+		c.cacheSize = config->cache_size;
+		c.blockSize = config->block_size;
+		c.nWay = config->associativity;
+		// the C enums mirror CacheConfig's
+		c.policy = static_cast<CacheConfig::Policy>(config->policy);
+		c.index = static_cast<CacheConfig::Index>(config->index);
+		c.memorySize = config->memory_size;
+		c.victimEntries = config->victim_entries;
+		c.missCache = config->miss_cache!=0;
+		c.timing = config->timing!=0;
+		c.mshrs = config->mshrs;
+		c.window = config->window;
+		c.hitLatency = config->hit_latency;
+		c.missLatency = config->miss_latency;
+		c.ComputeStats();
+		if (c.memorySize==0) {
+			// the RAM size ComputeStats derives for the default kernel
+			// is never allocated
+			sim->tags_ = std::unique_ptr<TagOnlyCache>{ new TagOnlyCache(c) };
+		} else {
+			sim->cpu_ = std::unique_ptr<CPU>{ new CPU(c) };
+		}
+		return sim.release();
+	} catch (const std::exception&) {
+		return nullptr;
+	}
+}
+
+int cachesim_access_batch(cachesim * sim, const cachesim_access * accesses,
+		size_t count) {
+	if (!sim || (count && !accesses)) return CACHESIM_EINVAL;
+	if (sim->tags_) {
+		for (size_t i=0; i<count; ++i) {
+			sim->tags_->Access(accesses[i].address, accesses[i].write!=0);
+		}
+		return CACHESIM_OK;
+	}
+	const uint64_t limit = sim->config_.ramSize - sim->config_.wordSize;
+	for (size_t i=0; i<count; ++i) {
+		if (accesses[i].address > limit) return CACHESIM_ERANGE;
+	}
+	CPU& cpu = *sim->cpu_;
+	const AddressLayout& layout = cpu.GetLayout();
+	// stores all write zero, so values never matter: a run of reads
+	// or of writes to one block is a single access plus a repeat
+	try {
+		for (size_t i=0; i<count; ) {
+			Address address(static_cast<uint32_t>(accesses[i].address), layout);
+			const uint32_t write = accesses[i].write;
+			if (write) {
+				cpu.StoreDouble(address, 0.);
+			} else {
+				cpu.LoadDouble(address);
+			}
+			const uint32_t block = address.GetRamBlock();
+			uint32_t run = 0;
+			for (++i; i<count && (accesses[i].write!=0)==(write!=0); ++i, ++run) {
+				if (Address(static_cast<uint32_t>(accesses[i].address), layout).GetRamBlock()!=block) break;
+			}
+			if (run) cpu.RepeatLast(address, run, write!=0);
+		}
+	} catch (const std::exception&) {
+		return CACHESIM_EINVAL;
+	}
+	return CACHESIM_OK;
+}
+
+int cachesim_get_counters(const cachesim * sim, cachesim_counters * counters) {
+	if (!sim || !counters) return CACHESIM_EINVAL;
+	if (sim->tags_) {
+		counters->read_hits = sim->tags_->GetReadHits();
+		counters->read_misses = sim->tags_->GetReadMisses();
+		counters->write_hits = sim->tags_->GetWriteHits();
+		counters->write_misses = sim->tags_->GetWriteMisses();
+		counters->cycles = 0;
+		return CACHESIM_OK;
+	}
+	const Cache& cache = sim->cpu_->GetCache();
+	counters->read_hits = cache.GetReadHits();
+	counters->read_misses = cache.GetReadMisses();
+	counters->write_hits = cache.GetWriteHits();
+	counters->write_misses = cache.GetWriteMisses();
+	counters->cycles = sim->cpu_->GetCycles();
+	return CACHESIM_OK;
+}
+
+void cachesim_destroy(cachesim * sim) {
+	delete sim;
+}
+
+}
@@ -0,0 +1,106 @@
+#ifndef LIBCACHESIM_H
+#define LIBCACHESIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface to the cache simulator for in-process use. Every
+ * simulator is an independent instance; there is no global state, so
+ * any number of them may coexist in one process (one thread per
+ * instance at a time).
+ *
+ * By default (memory_size 0) an instance is tag-only: it keeps the
+ * replacement state of every set but no data, and takes any 64-bit
+ * byte address, so traces of real address spaces can be fed as they
+ * are. Setting memory_size instead runs the full simulator over a
+ * memory image of that many bytes (stores write zero into it);
+ * addresses must then fall below memory_size, which cannot exceed
+ * 32 bits. Only that mode supports the skewed index, the victim and
+ * miss buffers and the timing model.
+ */
+
+#if defined(__GNUC__)
+#define CACHESIM_API __attribute__((visibility("default")))
+#else
+#define CACHESIM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum cachesim_policy { CACHESIM_LRU, CACHESIM_FIFO, CACHESIM_RANDOM };
+
+enum cachesim_index {
+	CACHESIM_INDEX_MODULO,
+	CACHESIM_INDEX_XOR,
+	CACHESIM_INDEX_PRIME,
+	CACHESIM_INDEX_SKEWED
+};
+
+enum cachesim_status {
+	CACHESIM_OK = 0,
+	CACHESIM_EINVAL = -1,
+	CACHESIM_ERANGE = -2
+};
+
+typedef struct cachesim_config {
+	uint32_t cache_size;
+	uint32_t block_size;
+	uint32_t associativity;
+	uint32_t policy;
+	uint32_t index;
+	/* 0 for a tag-only instance, else bytes of simulated memory,
+	 * allocated in full; accesses must fall below it */
+	uint32_t memory_size;
+	/* fully associative victim (or, with miss_cache set, miss)
+	 * buffer entries, 0 for none; needs memory_size */
+	uint32_t victim_entries;
+	uint32_t miss_cache;
+	/* non-blocking timing model, off when 0; needs memory_size */
+	uint32_t timing;
+	uint32_t mshrs;
+	uint32_t window;
+	uint32_t hit_latency;
+	uint32_t miss_latency;
+} cachesim_config;
+
+typedef struct cachesim_access {
+	/* byte address; below memory_size when that is set */
+	uint64_t address;
+	uint32_t write;
+} cachesim_access;
+
+typedef struct cachesim_counters {
+	uint64_t read_hits;
+	uint64_t read_misses;
+	uint64_t write_hits;
+	uint64_t write_misses;
+	/* 0 unless the timing model is enabled */
+	uint64_t cycles;
+} cachesim_counters;
+
+typedef struct cachesim cachesim;
+
+/* fills in the simulator's defaults */
+CACHESIM_API void cachesim_config_init(cachesim_config * config);
+
+/* NULL if the configuration is invalid or allocation fails */
+CACHESIM_API cachesim * cachesim_create(const cachesim_config * config);
+
+/* simulates count accesses in order. with memory_size set the batch
+ * is checked first: if any address is out of range nothing is
+ * simulated and CACHESIM_ERANGE is returned. */
+CACHESIM_API int cachesim_access_batch(cachesim * sim, const cachesim_access * accesses,
+		size_t count);
+
+CACHESIM_API int cachesim_get_counters(const cachesim * sim, cachesim_counters * counters);
+
+CACHESIM_API void cachesim_destroy(cachesim * sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free single-producer/single-consumer ring buffer.
+// Exactly one thread may call the Push* functions and exactly
+// one (other) thread may call the Pop* functions. Capacity is
+// rounded up to a power of two so indices wrap with a mask.
+template <typename T>
+class SPSCRing {
+private:
+	static size_t constexpr CACHELINE = 64;
+
+	std::vector<T> slots_;
+	const size_t mask_;
+
+	// consumer-owned index, padded onto its own cache line
+	// so the producer does not false-share with it
+	char pad0_[CACHELINE];
+	std::atomic<size_t> head_;
+	size_t cachedTail_;
+	char pad1_[CACHELINE];
+	// producer-owned index
+	std::atomic<size_t> tail_;
+	size_t cachedHead_;
+	char pad2_[CACHELINE];
+
+	static size_t RoundUp(size_t n) {
+		size_t ret = 1;
+		while (ret < n) ret <<= 1;
+		return ret;
+	}
+
+public:
+	SPSCRing(size_t capacity) : slots_(RoundUp(capacity)),
+		mask_(RoundUp(capacity) - 1), head_(0), cachedTail_(0),
+		tail_(0), cachedHead_(0) {}
+
+	SPSCRing(const SPSCRing&) = delete;
+	SPSCRing& operator=(const SPSCRing&) = delete;
+
+	size_t Capacity() const { return this->mask_ + 1; }
+
+	// producer side: copies up to n items in, returns how many fit.
+	// the shared head is only re-read when the cached copy says full.
+	size_t PushBatch(const T * items, size_t n) {
+		const size_t tail = this->tail_.load(std::memory_order_relaxed);
+		size_t space = this->Capacity() - (tail - this->cachedHead_);
+		if (space < n) {
+			this->cachedHead_ = this->head_.load(std::memory_order_acquire);
+			space = this->Capacity() - (tail - this->cachedHead_);
+		}
+		if (n > space) n = space;
+		for (size_t i=0; i<n; ++i) {
+			this->slots_[(tail + i) & this->mask_] = items[i];
+		}
+		this->tail_.store(tail + n, std::memory_order_release);
+		return n;
+	}
+
+	bool Push(const T& item) {
+		return this->PushBatch(&item, 1) == 1;
+	}
+
+	// consumer side: copies up to max items out, returns how many.
+	size_t PopBatch(T * out, size_t max) {
+		const size_t head = this->head_.load(std::memory_order_relaxed);
+		size_t avail = this->cachedTail_ - head;
+		if (avail < max) {
+			this->cachedTail_ = this->tail_.load(std::memory_order_acquire);
+			avail = this->cachedTail_ - head;
+		}
+		if (max > avail) max = avail;
+		for (size_t i=0; i<max; ++i) {
+			out[i] = this->slots_[(head + i) & this->mask_];
+		}
+		this->head_.store(head + max, std::memory_order_release);
+		return max;
+	}
+
+	bool Pop(T& item) {
+		return this->PopBatch(&item, 1) == 1;
+	}
+
+	bool Empty() const {
+		return this->head_.load(std::memory_order_acquire) ==
+				this->tail_.load(std::memory_order_acquire);
+	}
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef SAMPLING_HPP
+#define SAMPLING_HPP
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <stdint.h>
+
+// Statistical sampling of the access stream. Two schemes, usable
+// together:
+//  - set sampling: only a deterministic, hash-selected 1-in-k
+//    subset of sets is simulated; every sampled set is one unit.
+//  - interval sampling (SMARTS-style): each period of P accesses
+//    is skipped, then W accesses warm the cache without being
+//    measured, then U accesses are measured; every measured
+//    interval is one unit.
+// Accesses classified Skip never reach the Cache. Miss rates are
+// reported with a ratio-estimator confidence interval over units.
+class Sampler {
+public:
+	enum Verdict { Skip, Warm, Detail };
+
+private:
+	struct Unit {
+		unsigned long long reads_;
+		unsigned long long readMisses_;
+		unsigned long long writes_;
+		unsigned long long writeMisses_;
+		Unit() : reads_(0), readMisses_(0), writes_(0), writeMisses_(0) {}
+	};
+
+	// 95% two-sided normal quantile
+	static double constexpr Z95 = 1.96;
+
+	const uint32_t numSets_;
+	const uint32_t setRatio_;
+	const uint32_t period_;
+	const uint32_t warmup_;
+	const uint32_t detail_;
+	// per set: index into units_ when sampled, -1 otherwise
+	std::vector<int32_t> setUnit_;
+	std::vector<Unit> units_;
+	uint32_t sampledSets_;
+	uint32_t pos_;
+	Unit * current_;
+	unsigned long long observed_;
+	unsigned long long warmed_;
+	unsigned long long measured_;
+
+	static uint32_t Mix(uint32_t h) {
+		// murmur3 finalizer: spreads power-of-two strided set
+		// indices so the sample is not aligned with the workload
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	bool IntervalSampling() const { return this->period_!=0; }
+
+	// ratio estimator of misses/accesses over units together
+	// with its 95% half-width, with finite population correction
+	void Estimate(bool write, double& rate, double& halfWidth) const {
+		double sumX = 0, sumY = 0;
+		for (const Unit& u : this->units_) {
+			sumX += write ? u.writes_ : u.reads_;
+			sumY += write ? u.writeMisses_ : u.readMisses_;
+		}
+		rate = sumX > 0 ? sumY / sumX : 0;
+		halfWidth = 0;
+		const double n = this->units_.size();
+		if (n < 2 || sumX == 0) return;
+		double ss = 0;
+		for (const Unit& u : this->units_) {
+			double x = write ? u.writes_ : u.reads_;
+			double y = write ? u.writeMisses_ : u.readMisses_;
+			ss += (y - rate*x) * (y - rate*x);
+		}
+		const double f = this->IntervalSampling() ? 0 :
+				static_cast<double>(this->sampledSets_) / this->numSets_;
+		const double meanX = sumX / n;
+		const double se = sqrt((1 - f) * (ss / (n - 1)) / n) / meanX;
+		halfWidth = Z95 * se;
+	}
+
+	void PrintRate(const char * label, bool write) const {
+		double rate, hw;
+		this->Estimate(write, rate, hw);
+		std::cout << label << " miss rate: " << rate << " +/- " << hw <<
+			" (95% CI)" << std::endl;
+	}
+
+public:
+	Sampler(uint32_t numSets, uint32_t setRatio, uint32_t period,
+		uint32_t warmup, uint32_t detail) :
+		numSets_(numSets), setRatio_(setRatio), period_(period),
+		warmup_(warmup), detail_(detail), setUnit_(numSets, -1),
+		sampledSets_(0), pos_(0), current_(nullptr), observed_(0),
+		warmed_(0), measured_(0) {
+
+		const uint32_t ratio = setRatio ? setRatio : 1;
+		for (uint32_t s=0; s<numSets; ++s) {
+			if (Mix(s) % ratio == 0) {
+				this->setUnit_[s] = this->sampledSets_++;
+			}
+		}
+		if (this->sampledSets_==0) {
+			// too few sets for the ratio: keep at least one
+			this->setUnit_[0] = this->sampledSets_++;
+		}
+		if (!this->IntervalSampling()) {
+			this->units_.resize(this->sampledSets_);
+		}
+	}
+
+	// advances the interval clock and decides what to do with the
+	// access to setIndex. a Detail verdict must be followed by Record.
+	Verdict Classify(const uint32_t setIndex) {
+		++this->observed_;
+		Verdict v = Detail;
+		if (this->IntervalSampling()) {
+			const uint32_t pos = this->pos_;
+			if (++this->pos_ == this->period_) this->pos_ = 0;
+			const uint32_t skip = this->period_ - this->warmup_ - this->detail_;
+			if (pos < skip) {
+				v = Skip;
+			} else if (pos < skip + this->warmup_) {
+				v = Warm;
+			} else if (pos == skip + this->warmup_) {
+				// first access of a new measured interval
+				this->units_.push_back(Unit());
+			}
+			if (!this->units_.empty()) this->current_ = &this->units_.back();
+		}
+		if (v!=Skip && this->setUnit_[setIndex] < 0) {
+			return Skip;
+		}
+		if (v==Warm) {
+			++this->warmed_;
+		} else if (v==Detail && !this->IntervalSampling()) {
+			this->current_ = &this->units_[this->setUnit_[setIndex]];
+		}
+		return v;
+	}
+
+	void Record(const bool write, const bool miss) {
+		++this->measured_;
+		if (write) {
+			++this->current_->writes_;
+			this->current_->writeMisses_ += miss;
+		} else {
+			++this->current_->reads_;
+			this->current_->readMisses_ += miss;
+		}
+	}
+
+	void PrintStats() const {
+		std::cout << "SAMPLING" << std::string(24, '=') << std::endl;
+		if (this->setRatio_) {
+			std::cout << "Sampled Sets: " << this->sampledSets_ << " of " <<
+				this->numSets_ << std::endl;
+		}
+		if (this->IntervalSampling()) {
+			std::cout << "Sampled Intervals: " << this->units_.size() <<
+				" (period " << this->period_ << ", warm-up " << this->warmup_ <<
+				", detail " << this->detail_ << ")" << std::endl;
+		}
+		std::cout << "Accesses Observed: " << this->observed_ << std::endl;
+		std::cout << "Accesses Warmed: " << this->warmed_ << std::endl;
+		std::cout << "Accesses Measured: " << this->measured_ << std::endl;
+		this->PrintRate("Estimated read", false);
+		this->PrintRate("Estimated write", true);
+	}
+};
+
+#endif
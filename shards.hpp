@@ -0,0 +1,174 @@
+#ifndef SHARDS_HPP
+#define SHARDS_HPP
+
+#include <vector>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <stdint.h>
+#include "tagcache.hpp"
+
+// Approximate miss-ratio curves via SHARDS-style spatial sampling and
+// miniature simulation. Sampling is done on whole sets rather than on
+// blocks: every simulated size keeps the set count and index function
+// of the real cache at that size, and a set is sampled iff its hash
+// ranks among the lowest sets*rate ones. A sampled set sees all of its
+// references and no others, so it evolves exactly as in the full
+// cache, and each miss ratio is the sampled misses over the sampled
+// references. (Scaling the ways down by the rate instead cannot keep
+// the associativity of a 4-way cache at rate 0.1.) Only the sampled
+// sets are stored, in one TagCache per policy. With a sample budget
+// (fixed-size SHARDS) a size drops its highest ranked set, together
+// with that set's counts, whenever more than maxSamples distinct blocks
+// are tracked, down to a single set, so memory is bounded
+// independently of the trace length.
+template <class Index>
+class MRCProfiler {
+private:
+	static uint32_t constexpr POLICIES = 3;
+	static int32_t constexpr UNSAMPLED = -1;
+
+	struct Point {
+		uint32_t size_;
+		uint32_t sets_;
+		uint32_t sampled_;
+		Index index_;
+		// compact slot of every sampled set, UNSAMPLED otherwise;
+		// slots are numbered in rank order
+		std::vector<int32_t> slots_;
+		// (hash, set) of the sampled sets, lowest hash first
+		std::vector< std::pair<uint32_t, uint32_t> > ranks_;
+		// references and misses per policy, per slot and in total
+		std::vector<unsigned long long> slotReferences_;
+		std::vector<unsigned long long> slotMisses_;
+		unsigned long long references_;
+		unsigned long long misses_[POLICIES];
+		std::vector<TagCache> caches_;
+		// (slot, block) of every tracked block when budgeted
+		std::set< std::pair<uint32_t, uint32_t> > tracked_;
+
+		Point(uint32_t size, uint32_t sets, const Index& index) :
+			size_(size), sets_(sets), sampled_(0), index_(index),
+			slots_(sets, UNSAMPLED), references_(0) {}
+	};
+
+	const uint32_t maxSamples_;
+	const double rate_;
+	std::vector<Point> points_;
+	unsigned long long observed_;
+
+	static uint32_t Hash(uint32_t set) {
+		// splitmix64 finalizer
+		uint64_t z = set + 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		z ^= z >> 31;
+		return static_cast<uint32_t>(z >> 32);
+	}
+
+	// stop sampling the highest ranked set of p
+	void Drop(Point& p) {
+		const uint32_t set = p.ranks_.back().second;
+		p.ranks_.pop_back();
+		const int32_t slot = p.slots_[set];
+		p.slots_[set] = UNSAMPLED;
+		--p.sampled_;
+		p.references_ -= p.slotReferences_[slot];
+		for (uint32_t i=0; i<POLICIES; ++i) {
+			p.misses_[i] -= p.slotMisses_[slot * POLICIES + i];
+			p.caches_[i].ClearSet(slot);
+		}
+		if (p.sampled_ > 1) {
+			p.tracked_.erase(p.tracked_.lower_bound(
+					std::make_pair(static_cast<uint32_t>(slot), 0u)), p.tracked_.end());
+		} else {
+			// the last set is kept whatever the budget
+			p.tracked_.clear();
+		}
+	}
+
+public:
+	// sizes are (cache size, set count) pairs, each indexed by the
+	// matching entry of indices
+	MRCProfiler(const std::vector< std::pair<uint32_t, uint32_t> >& sizes,
+		const std::vector<Index>& indices, uint32_t nWay, double rate,
+		uint32_t maxSamples) :
+		maxSamples_(maxSamples),
+		rate_(rate > 0 && rate < 1 ? rate : 1), observed_(0) {
+
+		this->points_.reserve(sizes.size());
+		for (size_t s=0; s<sizes.size(); ++s) {
+			this->points_.push_back(Point(sizes[s].first, sizes[s].second, indices[s]));
+			Point& p = this->points_.back();
+			for (uint32_t set=0; set<p.sets_; ++set) {
+				p.ranks_.push_back(std::make_pair(Hash(set), set));
+			}
+			std::sort(p.ranks_.begin(), p.ranks_.end());
+			uint32_t sampled = static_cast<uint32_t>(p.sets_ * this->rate_ + 0.5);
+			if (sampled < 1) sampled = 1;
+			p.ranks_.resize(sampled);
+			for (uint32_t slot=0; slot<sampled; ++slot) {
+				p.slots_[p.ranks_[slot].second] = slot;
+			}
+			p.sampled_ = sampled;
+			p.slotReferences_.assign(sampled, 0);
+			p.slotMisses_.assign(sampled * POLICIES, 0);
+			for (uint32_t i=0; i<POLICIES; ++i) {
+				p.misses_[i] = 0;
+				p.caches_.push_back(TagCache(sampled, nWay,
+					static_cast<TagCache::Policy>(i), i + 1));
+			}
+		}
+	}
+
+	void Access(const uint32_t block) {
+		++this->observed_;
+		for (Point& p : this->points_) {
+			const uint32_t set = p.index_(block);
+			const int32_t slot = p.slots_[set];
+			if (slot==UNSAMPLED) continue;
+			if (this->maxSamples_ && p.sampled_ > 1) {
+				p.tracked_.insert(std::make_pair(static_cast<uint32_t>(slot), block));
+				if (p.tracked_.size() > this->maxSamples_) {
+					this->Drop(p);
+					if (p.slots_[set]==UNSAMPLED) continue;
+				}
+			}
+			++p.references_;
+			++p.slotReferences_[slot];
+			for (uint32_t i=0; i<POLICIES; ++i) {
+				if (!p.caches_[i].AccessSet(slot, block)) {
+					++p.misses_[i];
+					++p.slotMisses_[slot * POLICIES + i];
+				}
+			}
+		}
+	}
+
+	void PrintStats() const {
+		std::cout << "MRC (SHARDS)" << std::string(20, '=') << std::endl;
+		std::cout << "Sampling Rate: " << this->rate_ <<
+			(this->maxSamples_ ? " (adaptive)" : " (fixed)") << std::endl;
+		std::cout << "References Observed: " << this->observed_ << std::endl;
+		std::cout << std::setw(12) << "Cache Size" << std::setw(12) << "Sets" <<
+			std::setw(12) << "LRU" << std::setw(12) << "FIFO" <<
+			std::setw(12) << "Random" << std::endl;
+		for (const Point& p : this->points_) {
+			std::cout << std::setw(12) << p.size_ << std::setw(12) <<
+				(std::to_string(p.sampled_) + "/" + std::to_string(p.sets_));
+			for (uint32_t i=0; i<POLICIES; ++i) {
+				std::cout << std::setw(12) << (p.references_ > 0 ?
+						static_cast<double>(p.misses_[i]) / p.references_ : 0);
+			}
+			std::cout << std::endl;
+		}
+	}
+};
+
+template <class Index> uint32_t constexpr MRCProfiler<Index>::POLICIES;
+template <class Index> int32_t constexpr MRCProfiler<Index>::UNSAMPLED;
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef STEADY_HPP
+#define STEADY_HPP
+
+#include <vector>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+// Detects when a kernel settles into a steady state. At every outer
+// iteration boundary the caller passes its cumulative counters. The
+// counter deltas of the iteration just finished are hashed, and a
+// period p is reported once each of the last REPEATS*p iterations (and
+// at least MIN_MATCHES, since short runs of equal iterations are common
+// inside longer periods) matched the one p iterations before it. One
+// run-length counter per candidate period keeps the cost per boundary
+// at O(MAX_PERIOD). Equal counts do not make equal states, so Recurs
+// then compares a fingerprint of the cache state at both ends of one
+// period; the fingerprint walks the whole cache and is only taken
+// twice per candidate period.
+class SteadyState {
+private:
+	static uint32_t constexpr MAX_PERIOD = 128;
+	static uint32_t constexpr REPEATS = 3;
+	static uint32_t constexpr MIN_MATCHES = 32;
+	static uint32_t constexpr HISTORY = MAX_PERIOD + 1;
+
+	// cumulative counters and iteration hashes of the last HISTORY
+	// boundaries, indexed by boundary modulo HISTORY
+	std::vector< std::vector<unsigned long long> > counters_;
+	std::vector<uint64_t> hashes_;
+	// match_[p]: consecutive iterations equal to the one p before
+	std::vector<uint32_t> match_;
+	unsigned long long boundaries_;
+	uint32_t period_;
+	unsigned long long detectedAt_;
+	unsigned long long skipped_;
+	// fingerprint taken at boundary pendingAt_ for period pending_
+	uint32_t pending_;
+	unsigned long long pendingAt_;
+	uint64_t pendingState_;
+
+	static uint64_t Mix(uint64_t h, uint64_t v) {
+		h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+		return h * 0xff51afd7ed558ccdull;
+	}
+
+public:
+	SteadyState() : counters_(HISTORY), hashes_(HISTORY, 0),
+		match_(MAX_PERIOD + 1, 0), boundaries_(0), period_(0),
+		detectedAt_(0), skipped_(0), pending_(0), pendingAt_(0),
+		pendingState_(0) {}
+
+	// returns the detected period, or 0 while none is established
+	uint32_t Boundary(const std::vector<unsigned long long>& counters) {
+		const unsigned long long t = this->boundaries_++;
+		const std::vector<unsigned long long>& prev = this->counters_[(t + HISTORY - 1) % HISTORY];
+		this->counters_[t % HISTORY] = counters;
+		if (t==0) return 0;
+		uint64_t h = 0;
+		for (size_t i=0; i<counters.size(); ++i) h = Mix(h, counters[i] - prev[i]);
+		this->hashes_[t % HISTORY] = h;
+
+		uint32_t found = 0;
+		// hashes exist for boundaries 1..t
+		for (uint32_t p=1; p<=MAX_PERIOD && p<t; ++p) {
+			const bool same = this->hashes_[(t - p) % HISTORY]==h;
+			this->match_[p] = same ? this->match_[p] + 1 : 0;
+			if (!found && this->match_[p] >= REPEATS * p &&
+					this->match_[p] >= MIN_MATCHES) {
+				found = p;
+			}
+		}
+		return found;
+	}
+
+	// called at boundaries where Boundary reported p: true once the
+	// state fingerprint is the one taken p boundaries before. the
+	// first call takes the fingerprint, later ones within the period
+	// wait for its end.
+	template <class Fingerprint>
+	bool Recurs(const uint32_t p, const Fingerprint& fingerprint) {
+		const unsigned long long t = this->boundaries_ - 1;
+		if (this->pending_==p && t - this->pendingAt_ < p) return false;
+		const uint64_t state = fingerprint();
+		if (this->pending_==p && t - this->pendingAt_==p &&
+				state==this->pendingState_) {
+			return true;
+		}
+		this->pending_ = p;
+		this->pendingAt_ = t;
+		this->pendingState_ = state;
+		return false;
+	}
+
+	// counter deltas over the last p iterations
+	std::vector<unsigned long long> PeriodDelta(const uint32_t p) const {
+		const unsigned long long t = this->boundaries_ - 1;
+		const std::vector<unsigned long long>& now = this->counters_[t % HISTORY];
+		const std::vector<unsigned long long>& then = this->counters_[(t - p) % HISTORY];
+		std::vector<unsigned long long> delta(now.size());
+		for (size_t i=0; i<now.size(); ++i) delta[i] = now[i] - then[i];
+		return delta;
+	}
+
+	void RecordSkip(const uint32_t period, const unsigned long long iterations) {
+		this->period_ = period;
+		this->detectedAt_ = this->boundaries_ - 1;
+		this->skipped_ = iterations;
+	}
+
+	void PrintStats() const {
+		std::cout << "FAST-FORWARD" << std::string(20, '=') << std::endl;
+		if (!this->period_) {
+			std::cout << "Steady state: not detected" << std::endl;
+			return;
+		}
+		std::cout << "Steady state period: " << this->period_ << " iterations" << std::endl;
+		std::cout << "Detected at iteration: " << this->detectedAt_ << std::endl;
+		std::cout << "Iterations fast-forwarded: " << this->skipped_ << std::endl;
+	}
+};
+
+#endif
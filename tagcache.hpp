@@ -0,0 +1,190 @@
+#ifndef TAGCACHE_HPP
+#define TAGCACHE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "tagsearch.hpp"
+
+// Tag-only set-associative array with LRU, FIFO or random
+// replacement. Unlike Cache it carries no data and no RAM, so it is
+// cheap enough to keep many of them around (miniature caches for
+// MRCs, TLBs, victim buffers). Keys are whole block/page numbers;
+// the set is key % sets, so set counts need not be powers of two,
+// unless the caller maps keys to sets itself through AccessSet.
+// Keys and their 32-bit ages are kept in separate arrays so that in
+// wide sets (fully-associative victim buffers, big TLB levels) both
+// the lookup and the victim choice are vectorized TagSearch passes
+// over contiguous words; TagSearch::INVALID marks an empty way and is
+// never a key.
+class TagCache {
+public:
+	enum Policy { LRU, FIFO, Random };
+
+private:
+	const uint32_t sets_;
+	const uint32_t ways_;
+	const Policy policy_;
+	const TagSearch search_;
+	std::vector<uint32_t> keys_;
+	// 0 marks an invalid entry. LRU refreshes it on every hit,
+	// FIFO only sets it on fill.
+	std::vector<uint32_t> ages_;
+	// all zero: every way may be chosen
+	const std::vector<uint32_t> bias_;
+	uint32_t clock_;
+	uint32_t rng_;
+	uint32_t occupancy_;
+
+	uint32_t NextRandom() {
+		// xorshift32: cheap and, unlike rand(), owned per instance
+		uint32_t x = this->rng_;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return this->rng_ = x;
+	}
+
+	size_t Set(const uint32_t key) const {
+		return static_cast<size_t>(key % this->sets_) * this->ways_;
+	}
+
+	int Find(const size_t set, const uint32_t key) const {
+		return this->search_.Find(&this->keys_[set], this->ways_, key);
+	}
+
+	// the first invalid way of set if any, else its oldest
+	size_t Oldest(const size_t set) const {
+		return set + this->search_.Oldest(&this->ages_[set], this->bias_.data(), this->ways_);
+	}
+
+	// slot to fill in set: an invalid way if any, else the victim
+	size_t Victim(const size_t set) {
+		const size_t victim = this->Oldest(set);
+		if (this->ages_[victim]!=0 && this->policy_==Random) {
+			return set + this->NextRandom() % this->ways_;
+		}
+		return victim;
+	}
+
+	bool AccessAt(const size_t set, const uint32_t key, bool * didEvict = nullptr,
+			uint32_t * evicted = nullptr) {
+		const int w = this->Find(set, key);
+		if (w >= 0) {
+			if (this->policy_==LRU) this->ages_[set + w] = this->Tick();
+			return true;
+		}
+		this->FillAt(set, key, didEvict, evicted);
+		return false;
+	}
+
+	void FillAt(const size_t set, const uint32_t key, bool * didEvict,
+			uint32_t * evicted) {
+		const uint32_t age = this->Tick();
+		const size_t victim = this->Victim(set);
+		const bool full = this->ages_[victim]!=0;
+		if (didEvict) *didEvict = full;
+		if (full && evicted) *evicted = this->keys_[victim];
+		if (!full) ++this->occupancy_;
+		this->keys_[victim] = key;
+		this->ages_[victim] = age;
+	}
+
+	// resident entries as (age, key), oldest first
+	std::vector< std::pair<uint32_t, uint32_t> > Live() const {
+		std::vector< std::pair<uint32_t, uint32_t> > live;
+		live.reserve(this->occupancy_);
+		for (size_t i=0; i<this->keys_.size(); ++i) {
+			if (this->ages_[i]!=0) live.push_back(std::make_pair(this->ages_[i], this->keys_[i]));
+		}
+		std::sort(live.begin(), live.end());
+		return live;
+	}
+
+	// next age; when the clock runs out every entry is renumbered
+	// 1.. in age order, in place, which keeps every decision
+	uint32_t Tick() {
+		if (this->clock_==TagSearch::INVALID - 1) {
+			std::vector<size_t> order;
+			order.reserve(this->occupancy_);
+			for (size_t i=0; i<this->ages_.size(); ++i) {
+				if (this->ages_[i]!=0) order.push_back(i);
+			}
+			const std::vector<uint32_t>& ages = this->ages_;
+			std::sort(order.begin(), order.end(), [&ages](size_t x, size_t y) {
+				return ages[x] < ages[y];
+			});
+			for (size_t i=0; i<order.size(); ++i) this->ages_[order[i]] = i + 1;
+			this->clock_ = order.size();
+		}
+		return ++this->clock_;
+	}
+
+public:
+	TagCache(uint32_t sets, uint32_t ways, Policy policy, uint32_t seed = 1) :
+		sets_(sets ? sets : 1), ways_(ways ? ways : 1), policy_(policy),
+		keys_(static_cast<size_t>(sets_) * ways_, static_cast<uint32_t>(TagSearch::INVALID)),
+		ages_(static_cast<size_t>(sets_) * ways_, 0), bias_(ways_, 0),
+		clock_(0), rng_(seed ? seed : 1), occupancy_(0) {}
+
+	uint32_t GetSets() const { return this->sets_; }
+	uint32_t GetWays() const { return this->ways_; }
+	uint32_t GetOccupancy() const { return this->occupancy_; }
+
+	// lookup without touching replacement state
+	bool Probe(const uint32_t key) const {
+		return this->Find(this->Set(key), key) >= 0;
+	}
+
+	// lookup and fill on miss. returns true on a hit. when the fill
+	// displaces a valid entry its key is written to *evicted.
+	bool Access(const uint32_t key, bool * didEvict = nullptr,
+			uint32_t * evicted = nullptr) {
+		return this->AccessAt(this->Set(key), key, didEvict, evicted);
+	}
+
+	// Access with the set chosen by the caller, for any index
+	// function; set must be below GetSets()
+	bool AccessSet(const uint32_t set, const uint32_t key) {
+		return this->AccessAt(static_cast<size_t>(set) * this->ways_, key);
+	}
+
+	// unconditional insert of a key known to be absent
+	void Fill(const uint32_t key, bool * didEvict = nullptr,
+			uint32_t * evicted = nullptr) {
+		this->FillAt(this->Set(key), key, didEvict, evicted);
+	}
+
+	bool Remove(const uint32_t key) {
+		const size_t set = this->Set(key);
+		const int w = this->Find(set, key);
+		if (w < 0) return false;
+		this->keys_[set + w] = TagSearch::INVALID;
+		this->ages_[set + w] = 0;
+		--this->occupancy_;
+		return true;
+	}
+
+	// resident keys, least recently stamped first; filling them in
+	// this order into an empty instance of the same shape rebuilds
+	// the LRU/FIFO state
+	std::vector<uint32_t> Keys() const {
+		const std::vector< std::pair<uint32_t, uint32_t> > live = this->Live();
+		std::vector<uint32_t> keys;
+		keys.reserve(live.size());
+		for (const std::pair<uint32_t, uint32_t>& e : live) keys.push_back(e.second);
+		return keys;
+	}
+
+	// empties one set, e.g. one that is no longer sampled
+	void ClearSet(const uint32_t set) {
+		const size_t base = static_cast<size_t>(set) * this->ways_;
+		for (size_t i=base; i<base + this->ways_; ++i) {
+			if (this->ages_[i]!=0) --this->occupancy_;
+			this->keys_[i] = TagSearch::INVALID;
+			this->ages_[i] = 0;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef TAGSEARCH_HPP
+#define TAGSEARCH_HPP
+
+#include <algorithm>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TAGSEARCH_X86 1
+#else
+#define TAGSEARCH_X86 0
+#endif
+
+// Linear searches over contiguous 32-bit tag and age arrays, the
+// inner loops of the high-associativity engines. Each exists as
+// scalar code and, on x86, as SSE2 and AVX2 variants compiled with
+// target attributes, so the binary needs no -m flags and picks the
+// widest the CPU supports at run time. An instance holds the chosen
+// variants; short arrays are searched inline since a vector pass
+// and the indirect call would not pay off.
+class TagSearch {
+public:
+	enum Level { Scalar, SSE2, AVX2 };
+	// tag of an empty way; block and page numbers never reach it
+	static uint32_t constexpr INVALID = ~0u;
+
+private:
+	static uint32_t constexpr INLINE_WAYS = 8;
+
+	typedef int (*FindFn)(const uint32_t *, uint32_t, uint32_t);
+	typedef uint32_t (*OldestFn)(const uint32_t *, const uint32_t *, uint32_t);
+
+	const Level level_;
+	const FindFn find_;
+	const OldestFn oldest_;
+
+	static int FindScalar(const uint32_t * tags, const uint32_t n, const uint32_t key) {
+		for (uint32_t i=0; i<n; ++i) {
+			if (tags[i]==key) return i;
+		}
+		return -1;
+	}
+
+	static uint32_t OldestScalar(const uint32_t * ages, const uint32_t * bias,
+			const uint32_t n) {
+		uint32_t best = 0;
+		uint32_t min = ages[0] | bias[0];
+		for (uint32_t i=1; i<n; ++i) {
+			if ((ages[i] | bias[i]) < min) {
+				min = ages[i] | bias[i];
+				best = i;
+			}
+		}
+		return best;
+	}
+
+	// first i at or after from with ages[i] | bias[i]==value
+	static uint32_t FirstEqual(const uint32_t * ages, const uint32_t * bias,
+			uint32_t from, const uint32_t n, const uint32_t value) {
+		for (; from<n; ++from) {
+			if ((ages[from] | bias[from])==value) break;
+		}
+		return from;
+	}
+
+#if TAGSEARCH_X86
+	__attribute__((target("sse2")))
+	static int FindSSE2(const uint32_t * tags, const uint32_t n, const uint32_t key) {
+		const __m128i k = _mm_set1_epi32(key);
+		uint32_t i = 0;
+		for (; i+4<=n; i+=4) {
+			const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags + i));
+			const int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(t, k)));
+			if (m) return i + __builtin_ctz(m);
+		}
+		const int rest = FindScalar(tags + i, n - i, key);
+		return rest < 0 ? -1 : static_cast<int>(i) + rest;
+	}
+
+	// SSE2 has no unsigned 32-bit min: flip the sign bits and take
+	// the signed one with a compare and blend
+	__attribute__((target("sse2")))
+	static uint32_t OldestSSE2(const uint32_t * ages, const uint32_t * bias,
+			const uint32_t n) {
+		if (n < 4) return OldestScalar(ages, bias, n);
+		const __m128i flip = _mm_set1_epi32(0x80000000);
+		__m128i min = _mm_set1_epi32(0x7fffffff);
+		uint32_t i = 0;
+		for (; i+4<=n; i+=4) {
+			const __m128i v = _mm_xor_si128(flip, _mm_or_si128(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(ages + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(bias + i))));
+			const __m128i lt = _mm_cmplt_epi32(v, min);
+			min = _mm_or_si128(_mm_and_si128(lt, v), _mm_andnot_si128(lt, min));
+		}
+		uint32_t lanes[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), _mm_xor_si128(flip, min));
+		uint32_t value = *std::min_element(lanes, lanes + 4);
+		for (uint32_t j=i; j<n; ++j) value = std::min(value, ages[j] | bias[j]);
+		const __m128i m = _mm_set1_epi32(value);
+		for (i=0; i+4<=n; i+=4) {
+			const __m128i v = _mm_or_si128(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(ages + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(bias + i)));
+			const int eq = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, m)));
+			if (eq) return i + __builtin_ctz(eq);
+		}
+		return FirstEqual(ages, bias, i, n, value);
+	}
+
+	// 32 tags per iteration with a single branch; wide sets mostly
+	// scan past non-matching tags
+	__attribute__((target("avx2")))
+	static int FindAVX2(const uint32_t * tags, const uint32_t n, const uint32_t key) {
+		const __m256i k = _mm256_set1_epi32(key);
+		uint32_t i = 0;
+		for (; i+32<=n; i+=32) {
+			const __m256i * t = reinterpret_cast<const __m256i *>(tags + i);
+			const __m256i e0 = _mm256_cmpeq_epi32(k, _mm256_loadu_si256(t));
+			const __m256i e1 = _mm256_cmpeq_epi32(k, _mm256_loadu_si256(t + 1));
+			const __m256i e2 = _mm256_cmpeq_epi32(k, _mm256_loadu_si256(t + 2));
+			const __m256i e3 = _mm256_cmpeq_epi32(k, _mm256_loadu_si256(t + 3));
+			const __m256i any = _mm256_or_si256(_mm256_or_si256(e0, e1),
+					_mm256_or_si256(e2, e3));
+			if (_mm256_testz_si256(any, any)) continue;
+			const uint32_t m = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(e0))) |
+				static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(e1))) << 8 |
+				static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(e2))) << 16 |
+				static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(e3))) << 24;
+			return i + __builtin_ctz(m);
+		}
+		for (; i+8<=n; i+=8) {
+			const int m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(k,
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + i)))));
+			if (m) return i + __builtin_ctz(m);
+		}
+		const int rest = FindScalar(tags + i, n - i, key);
+		return rest < 0 ? -1 : static_cast<int>(i) + rest;
+	}
+
+	// two passes, an unsigned min over four independent accumulators
+	// and then a search for the first lane holding it, are cheaper
+	// than tracking indices alongside the minimum
+	__attribute__((target("avx2")))
+	static uint32_t OldestAVX2(const uint32_t * ages, const uint32_t * bias,
+			const uint32_t n) {
+		if (n < 8) return OldestScalar(ages, bias, n);
+		__m256i m0 = _mm256_set1_epi32(-1);
+		__m256i m1 = m0;
+		__m256i m2 = m0;
+		__m256i m3 = m0;
+		uint32_t i = 0;
+		for (; i+32<=n; i+=32) {
+			const __m256i * a = reinterpret_cast<const __m256i *>(ages + i);
+			const __m256i * b = reinterpret_cast<const __m256i *>(bias + i);
+			m0 = _mm256_min_epu32(m0, _mm256_or_si256(_mm256_loadu_si256(a), _mm256_loadu_si256(b)));
+			m1 = _mm256_min_epu32(m1, _mm256_or_si256(_mm256_loadu_si256(a + 1), _mm256_loadu_si256(b + 1)));
+			m2 = _mm256_min_epu32(m2, _mm256_or_si256(_mm256_loadu_si256(a + 2), _mm256_loadu_si256(b + 2)));
+			m3 = _mm256_min_epu32(m3, _mm256_or_si256(_mm256_loadu_si256(a + 3), _mm256_loadu_si256(b + 3)));
+		}
+		for (; i+8<=n; i+=8) {
+			m0 = _mm256_min_epu32(m0, _mm256_or_si256(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(ages + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(bias + i))));
+		}
+		const __m256i min = _mm256_min_epu32(_mm256_min_epu32(m0, m1), _mm256_min_epu32(m2, m3));
+		__m128i half = _mm_min_epu32(_mm256_castsi256_si128(min),
+				_mm256_extracti128_si256(min, 1));
+		half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0x4e));
+		half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0xb1));
+		uint32_t value = _mm_cvtsi128_si32(half);
+		for (uint32_t j=i; j<n; ++j) value = std::min(value, ages[j] | bias[j]);
+		const __m256i m = _mm256_set1_epi32(value);
+		for (i=0; i+8<=n; i+=8) {
+			const __m256i v = _mm256_or_si256(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(ages + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(bias + i)));
+			const int eq = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, m)));
+			if (eq) return i + __builtin_ctz(eq);
+		}
+		return FirstEqual(ages, bias, i, n, value);
+	}
+#endif
+
+	static FindFn FindFor(const Level level) {
+#if TAGSEARCH_X86
+		if (level==AVX2) return FindAVX2;
+		if (level==SSE2) return FindSSE2;
+#endif
+		return FindScalar;
+	}
+
+	static OldestFn OldestFor(const Level level) {
+#if TAGSEARCH_X86
+		if (level==AVX2) return OldestAVX2;
+		if (level==SSE2) return OldestSSE2;
+#endif
+		return OldestScalar;
+	}
+
+public:
+	// the widest variant this CPU runs
+	static Level Best() {
+#if TAGSEARCH_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return AVX2;
+		if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+		return Scalar;
+	}
+
+	static const char * Name(const Level level) {
+		static const char * const names[] = { "scalar", "sse2", "avx2" };
+		return names[level];
+	}
+
+	// limit caps the level, e.g. to compare variants
+	explicit TagSearch(const Level limit = AVX2) :
+		level_(std::min(limit, Best())), find_(FindFor(level_)),
+		oldest_(OldestFor(level_)) {}
+
+	Level GetLevel() const { return this->level_; }
+
+	// index of the first of the n tags equal to key, or -1
+	int Find(const uint32_t * tags, const uint32_t n, const uint32_t key) const {
+		if (n < INLINE_WAYS) return FindScalar(tags, n, key);
+		return this->find_(tags, n, key);
+	}
+
+	// index of the smallest of ages[i] | bias[i] over n entries, the
+	// first one on ties. a bias of ~0 keeps an entry from being
+	// chosen as long as some entry is below ~0.
+	uint32_t Oldest(const uint32_t * ages, const uint32_t * bias, const uint32_t n) const {
+		if (n < INLINE_WAYS) return OldestScalar(ages, bias, n);
+		return this->oldest_(ages, bias, n);
+	}
+};
+
+#endif
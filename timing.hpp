@@ -0,0 +1,181 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include "dram.hpp"
+
+// Cycle-level model of a non-blocking cache front end. Accesses issue
+// one per cycle in program order from an out-of-order window of
+// `window` entries that retire in order, so an access cannot issue
+// until the one `window` places older has retired. A miss allocates
+// one of `mshrs` miss status holding registers for its block; later
+// misses (or hits on a line whose fill is still in flight) to the same
+// block merge into it, and a new primary miss with every MSHR busy
+// stalls issue until the earliest one frees. Stores retire without
+// waiting for their fill. A single MSHR and a window of one reproduce
+// a blocking cache. Fills take a fixed latency unless a DRAM model is
+// attached, in which case it also receives the write-through stream.
+// A miss served by the victim or miss buffer is a short fill that
+// never reaches memory. A dependent access, such as the next level of
+// a page walk or the access waiting on the walk, issues only once the
+// access before it has completed.
+class TimingModel {
+public:
+	// where the functional cache found the block
+	enum Source { Hit, Buffer, Memory };
+
+private:
+	struct MSHR {
+		uint32_t block_;
+		unsigned long long ready_;
+	};
+
+	const uint32_t hitLatency_;
+	const uint32_t missLatency_;
+	const uint32_t bufferLatency_;
+	std::vector<MSHR> mshrs_;
+	// retire cycle of the last `window` accesses, indexed modulo window
+	std::vector<unsigned long long> retired_;
+	unsigned long long accesses_;
+	unsigned long long cycle_;
+	unsigned long long lastRetire_;
+	// completion cycle of the last access
+	unsigned long long lastComplete_;
+	unsigned long long primaryMisses_;
+	unsigned long long bufferFills_;
+	unsigned long long secondaryMisses_;
+	unsigned long long windowStalls_;
+	unsigned long long mshrStalls_;
+	unsigned long long dependStalls_;
+	// sum over primary misses of their latency, and the length of
+	// the union of their intervals (cycles with any miss outstanding)
+	unsigned long long missCycles_;
+	unsigned long long busyCycles_;
+	unsigned long long busyUntil_;
+	std::unique_ptr<DRAM> dram_;
+
+	// cycle at which a fill for block requested at cycle now arrives
+	unsigned long long Fetch(const uint32_t block, const Source source,
+			const unsigned long long now) {
+		if (source==Buffer) return now + this->bufferLatency_;
+		return this->dram_ ? this->dram_->Read(block, now) : now + this->missLatency_;
+	}
+
+public:
+	TimingModel(uint32_t hitLatency, uint32_t missLatency, uint32_t bufferLatency,
+		uint32_t mshrs, uint32_t window) :
+		hitLatency_(hitLatency), missLatency_(missLatency),
+		bufferLatency_(bufferLatency),
+		mshrs_(mshrs ? mshrs : 1), retired_(window ? window : 1, 0),
+		accesses_(0), cycle_(0), lastRetire_(0), lastComplete_(0),
+		primaryMisses_(0), bufferFills_(0), secondaryMisses_(0),
+		windowStalls_(0), mshrStalls_(0), dependStalls_(0),
+		missCycles_(0), busyCycles_(0), busyUntil_(0) {
+		for (MSHR& m : this->mshrs_) {
+			m.block_ = 0;
+			m.ready_ = 0;
+		}
+	}
+
+	void AttachDRAM(std::unique_ptr<DRAM> dram) {
+		this->dram_ = std::move(dram);
+	}
+
+	// drains buffered DRAM writes so their row-buffer effects count
+	void Finish() {
+		if (this->dram_) this->dram_->Flush();
+	}
+
+	// source is the functional cache's verdict for this access
+	void Access(const uint32_t block, const bool write, const Source source,
+			const bool dependent = false) {
+		unsigned long long& slot = this->retired_[this->accesses_++ % this->retired_.size()];
+		unsigned long long t = this->cycle_;
+		if (slot > t) {
+			this->windowStalls_ += slot - t;
+			t = slot;
+		}
+		if (dependent && this->lastComplete_ > t) {
+			this->dependStalls_ += this->lastComplete_ - t;
+			t = this->lastComplete_;
+		}
+
+		MSHR * pending = nullptr;
+		MSHR * free = nullptr;
+		MSHR * earliest = &this->mshrs_[0];
+		for (MSHR& m : this->mshrs_) {
+			if (m.ready_ > t) {
+				if (m.block_==block) pending = &m;
+			} else if (!free) {
+				free = &m;
+			}
+			if (m.ready_ < earliest->ready_) earliest = &m;
+		}
+
+		unsigned long long complete = t + this->hitLatency_;
+		if (pending) {
+			++this->secondaryMisses_;
+			complete = pending->ready_;
+		} else if (source!=Hit) {
+			if (!free) {
+				this->mshrStalls_ += earliest->ready_ - t;
+				t = earliest->ready_;
+				free = earliest;
+			}
+			if (source==Buffer) ++this->bufferFills_;
+			else ++this->primaryMisses_;
+			free->block_ = block;
+			free->ready_ = this->Fetch(block, source, t);
+			complete = free->ready_;
+			if (source==Memory) {
+				this->missCycles_ += complete - t;
+				const unsigned long long start = t > this->busyUntil_ ? t : this->busyUntil_;
+				if (complete > start) this->busyCycles_ += complete - start;
+				if (complete > this->busyUntil_) this->busyUntil_ = complete;
+			}
+		}
+		if (write) {
+			complete = t + this->hitLatency_;
+			if (this->dram_) this->dram_->Write(block, t);
+		}
+		this->lastComplete_ = complete;
+
+		if (complete > this->lastRetire_) this->lastRetire_ = complete;
+		slot = this->lastRetire_;
+		this->cycle_ = t + 1;
+	}
+
+	unsigned long long GetCycles() const {
+		return this->lastRetire_ > this->cycle_ ? this->lastRetire_ : this->cycle_;
+	}
+
+	void PrintStats() const {
+		const double cycles = this->GetCycles();
+		std::cout << "TIMING" << std::string(26, '=') << std::endl;
+		std::cout << "MSHRs: " << this->mshrs_.size() << std::endl;
+		std::cout << "Window: " << this->retired_.size() << std::endl;
+		std::cout << "Cycles: " << this->GetCycles() << std::endl;
+		std::cout << "Accesses per cycle: " << (cycles ? this->accesses_ / cycles : 0) << std::endl;
+		std::cout << "Primary misses: " << this->primaryMisses_ << std::endl;
+		std::cout << "Secondary (merged) misses: " << this->secondaryMisses_ << std::endl;
+		std::cout << "Buffer fills: " << this->bufferFills_ << std::endl;
+		std::cout << "Window stall cycles: " << this->windowStalls_ << std::endl;
+		std::cout << "MSHR stall cycles: " << this->mshrStalls_ << std::endl;
+		std::cout << "Dependency stall cycles: " << this->dependStalls_ << std::endl;
+		std::cout << "Average outstanding misses: " <<
+			(cycles ? this->missCycles_ / cycles : 0) << std::endl;
+		std::cout << "MLP: " << (this->busyCycles_ ?
+			static_cast<double>(this->missCycles_) / this->busyCycles_ : 0) << std::endl;
+		if (this->primaryMisses_) {
+			std::cout << "Average miss latency: " <<
+				static_cast<double>(this->missCycles_) / this->primaryMisses_ << std::endl;
+		}
+		if (this->dram_) this->dram_->PrintStats();
+	}
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef TLB_HPP
+#define TLB_HPP
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include "tagcache.hpp"
+
+// Two-level data TLB (L1 DTLB backed by a unified STLB) in front of
+// the cache. A miss in both levels is a page walk. The page table is
+// modelled as a radix tree of 8-byte entries with 512 entries per
+// node, living in its own region of RAM at tableBase: 4K pages walk a
+// directory and a leaf entry, 2M pages are mapped by the directory
+// entry alone. WalkAddress yields the entries a walk reads so the
+// caller can replay them through the data cache.
+class TLB {
+private:
+	static uint32_t constexpr ENTRY_SIZE = 8;
+	static uint32_t constexpr ENTRY_BITS = 9;
+	static uint32_t constexpr LARGE_PAGE = 2 * 1024 * 1024;
+
+	const uint32_t pageSize_;
+	uint32_t pageShift_;
+	const uint32_t levels_;
+	const uint32_t tableBase_;
+	// leaf entries start after the directory
+	const uint32_t leafBase_;
+	TagCache l1_;
+	TagCache l2_;
+	unsigned long long l1Hits_;
+	unsigned long long l1Misses_;
+	unsigned long long l2Hits_;
+	unsigned long long l2Misses_;
+	unsigned long long walkAccesses_;
+	unsigned long long walkMisses_;
+
+public:
+	TLB(uint32_t pageSize, uint32_t l1Entries, uint32_t l1Ways,
+		uint32_t l2Entries, uint32_t l2Ways, TagCache::Policy policy,
+		uint32_t tableBase, uint32_t dataSize) :
+		pageSize_(pageSize), pageShift_(0),
+		levels_(pageSize >= LARGE_PAGE ? 1 : 2), tableBase_(tableBase),
+		leafBase_(tableBase + DirectorySize(pageSize, dataSize)),
+		l1_(l1Entries / l1Ways, l1Ways, policy, 1),
+		l2_(l2Entries / l2Ways, l2Ways, policy, 2),
+		l1Hits_(0), l1Misses_(0), l2Hits_(0), l2Misses_(0),
+		walkAccesses_(0), walkMisses_(0) {
+		while ((1u << this->pageShift_) < pageSize) ++this->pageShift_;
+	}
+
+	static uint32_t Pages(uint32_t pageSize, uint32_t dataSize) {
+		return (dataSize + pageSize - 1) / pageSize;
+	}
+
+	static uint32_t DirectorySize(uint32_t pageSize, uint32_t dataSize) {
+		uint32_t pages = Pages(pageSize, dataSize);
+		if (pageSize >= LARGE_PAGE) return pages * ENTRY_SIZE;
+		return ((pages + (1 << ENTRY_BITS) - 1) >> ENTRY_BITS) * ENTRY_SIZE;
+	}
+
+	// bytes of RAM needed to hold the page table for dataSize bytes
+	static uint32_t TableSize(uint32_t pageSize, uint32_t dataSize) {
+		uint32_t size = DirectorySize(pageSize, dataSize);
+		if (pageSize < LARGE_PAGE) size += Pages(pageSize, dataSize) * ENTRY_SIZE;
+		return size;
+	}
+
+	uint32_t GetWalkLevels() const { return this->levels_; }
+	unsigned long long GetL1Misses() const { return this->l1Misses_; }
+	unsigned long long GetL2Misses() const { return this->l2Misses_; }
+
+	// returns true when both levels missed and a walk is needed
+	bool Translate(const uint32_t address) {
+		const uint32_t page = address >> this->pageShift_;
+		if (this->l1_.Access(page)) {
+			++this->l1Hits_;
+			return false;
+		}
+		++this->l1Misses_;
+		if (this->l2_.Access(page)) {
+			++this->l2Hits_;
+			return false;
+		}
+		++this->l2Misses_;
+		return true;
+	}
+
+	// address of the entry read at the given walk level, root first
+	uint32_t WalkAddress(const uint32_t address, const uint32_t level) const {
+		const uint32_t page = address >> this->pageShift_;
+		if (level==0 && this->levels_==2) {
+			return this->tableBase_ + (page >> ENTRY_BITS) * ENTRY_SIZE;
+		}
+		const uint32_t base = this->levels_==2 ? this->leafBase_ : this->tableBase_;
+		return base + page * ENTRY_SIZE;
+	}
+
+	void RecordWalk(const bool miss) {
+		++this->walkAccesses_;
+		this->walkMisses_ += miss;
+	}
+
+	void PrintStats() const {
+		std::cout << "TLB" << std::string(29, '=') << std::endl;
+		std::cout << "Page Size: " << this->pageSize_ << std::endl;
+		std::cout << "DTLB: " << this->l1_.GetSets() * this->l1_.GetWays() <<
+			" entries, " << this->l1_.GetWays() << "-way" << std::endl;
+		std::cout << "DTLB hits: " << this->l1Hits_ << std::endl;
+		std::cout << "DTLB misses: " << this->l1Misses_ << std::endl;
+		std::cout << "DTLB miss rate: " << static_cast<double>(this->l1Misses_) /
+			(this->l1Hits_ + this->l1Misses_) << std::endl;
+		std::cout << "STLB: " << this->l2_.GetSets() * this->l2_.GetWays() <<
+			" entries, " << this->l2_.GetWays() << "-way" << std::endl;
+		std::cout << "STLB hits: " << this->l2Hits_ << std::endl;
+		std::cout << "STLB misses: " << this->l2Misses_ << std::endl;
+		std::cout << "STLB miss rate: " << static_cast<double>(this->l2Misses_) /
+			(this->l2Hits_ + this->l2Misses_) << std::endl;
+		std::cout << "Page walks: " << this->l2Misses_ << std::endl;
+		if (this->walkAccesses_) {
+			std::cout << "Walk cache accesses: " << this->walkAccesses_ << std::endl;
+			std::cout << "Walk cache misses: " << this->walkMisses_ << std::endl;
+		}
+	}
+};
+
+#endif